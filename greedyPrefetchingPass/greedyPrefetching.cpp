@@ -1,16 +1,43 @@
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/Instructions.h>
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
 
 #include <queue>
 #include <string>
@@ -18,283 +45,4519 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <map>
 #include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <numeric>
 
 
 using namespace llvm;
 
+static cl::opt<unsigned> PrefetchDepth(
+    "greedy-prefetch-depth", cl::init(1),
+    cl::desc("Number of pointer levels to follow from a recursive argument "
+             "when prefetching (1 = children, 2 = grandchildren, ...)"));
+
+static cl::opt<bool> JumpPointerPrefetch(
+    "greedy-prefetch-jump-pointers", cl::init(false),
+    cl::desc("Record the node visited k steps later for recursive struct "
+             "arguments and prefetch through it on later traversals"));
+
+static cl::opt<unsigned> JumpPointerDistance(
+    "greedy-prefetch-jump-distance", cl::init(8),
+    cl::desc("Number of visits between a node and the node its jump pointer "
+             "refers to"));
+
+static cl::opt<unsigned> JumpPointerTableBits(
+    "greedy-prefetch-jump-table-bits", cl::init(12),
+    cl::desc("log2 of the number of entries in each traversal's jump pointer "
+             "table (clamped to [4, 20])"));
+
+static cl::opt<bool> LoopPrefetch(
+    "greedy-prefetch-loops", cl::init(true),
+    cl::desc("Prefetch ahead of pointer chasing loop inductions (p = p->next)"));
+
+static cl::opt<unsigned> LoopPrefetchDistance(
+    "greedy-prefetch-loop-distance", cl::init(1),
+    cl::desc("Number of nodes ahead of the current one to prefetch in a "
+             "pointer chasing loop"));
+
+static cl::opt<bool> BoundedArrays(
+    "greedy-prefetch-bounded-arrays", cl::init(true),
+    cl::desc("Prefetch child arrays that a loop walks up to a count member "
+             "with a loop bounded by that count"));
+
+static cl::opt<unsigned> MaxArrayPrefetches(
+    "greedy-prefetch-max-array-prefetches", cl::init(16),
+    cl::desc("Upper bound on the children prefetched from one bounded child array"));
+
+static cl::opt<unsigned> SiblingPrefetchDistance(
+    "greedy-prefetch-sibling-distance", cl::init(0),
+    cl::desc("Prefetch the child this many siblings ahead, and its pointer "
+             "members, before each recursive call in a loop over a bounded "
+             "child array (0 = prefetch child arrays at function entry)"));
+
+static cl::opt<bool> VisitOrder(
+    "greedy-prefetch-visit-order", cl::init(false),
+    cl::desc("Schedule prefetches by the order of the recursive calls: the "
+             "child visited first gets its own children prefetched, later "
+             "children are prefetched themselves"));
+
+static cl::opt<bool> SearchDescent(
+    "greedy-prefetch-search", cl::init(false),
+    cl::desc("For recursion into one child picked by a select or phi (search "
+             "descents), prefetch the candidate children a few levels down "
+             "instead of every child"));
+
+static cl::opt<unsigned> SearchDepth(
+    "greedy-prefetch-search-depth", cl::init(2),
+    cl::desc("Levels of candidate children prefetched for a search descent"));
+
+static cl::opt<unsigned> SearchMaxLines(
+    "greedy-prefetch-search-max-lines", cl::init(8),
+    cl::desc("Upper bound on the speculative cache lines prefetched at each "
+             "step of a search descent"));
+
+static cl::opt<bool> AllocationPrefetch(
+    "greedy-prefetch-alloc", cl::init(false),
+    cl::desc("In loops and recursion that allocate RDS nodes, prefetch the "
+             "predicted storage of the next allocation for writing"));
+
+static cl::opt<bool> PoolAllocation(
+    "greedy-prefetch-pool-alloc", cl::init(false),
+    cl::desc("Allocate the nodes of recursive structs from per type pools, in "
+             "construction order (link with libGreedyPrefetchRuntime.a; every "
+             "free of a node must be in the module)"));
+
+static cl::opt<bool> Relayout(
+    "greedy-prefetch-relayout", cl::init(false),
+    cl::desc("Copy trees returned by recursive constructors into cache line "
+             "sized subtree clusters (link with libGreedyPrefetchRuntime.a; "
+             "every free of a node must be in the module)"));
+
+static cl::opt<bool> SplitStructs(
+    "greedy-prefetch-split", cl::init(false),
+    cl::desc("Move the members of RDS structs that traversals don't read to a "
+             "separate cold struct behind a pointer"));
+
+static cl::opt<double> SplitColdRatio(
+    "greedy-prefetch-split-cold-ratio", cl::init(0.01),
+    cl::desc("With -greedy-prefetch-pgo, a member is cold when it is read less "
+             "than this fraction as often as the type's hottest member"));
+
+static cl::opt<bool> ReorderFields(
+    "greedy-prefetch-reorder", cl::init(false),
+    cl::desc("Move the links and hot members of RDS structs to the front so "
+             "that a traversal needs as few of a node's cache lines as possible"));
+
+static cl::opt<bool> CompressPointers(
+    "greedy-prefetch-compress", cl::init(false),
+    cl::desc("Store the links of RDS nodes as 32 bit indices into a region pool "
+             "(link with the runtime library)"));
+
+static cl::opt<bool> HelperThread(
+    "greedy-prefetch-helper-thread", cl::init(false),
+    cl::desc("Run the address slice of recursive traversals ahead of them on a helper thread "
+             "(link with the runtime library and -pthread)"));
+
+static cl::opt<unsigned> HelperLead(
+    "greedy-prefetch-helper-lead", cl::init(256),
+    cl::desc("Number of nodes the helper thread may run ahead of the traversal"));
+
+static cl::opt<bool> Interleave(
+    "greedy-prefetch-interleave", cl::init(false),
+    cl::desc("Interleave the pointer chasing lookups called once per iteration of a counted loop"));
+
+static cl::opt<unsigned> InterleaveGroup(
+    "greedy-prefetch-interleave-group", cl::init(8),
+    cl::desc("Number of lookups in flight at once when interleaving"));
+
+static cl::opt<bool> UsedFieldsOnly(
+    "greedy-prefetch-used-fields", cl::init(true),
+    cl::desc("Only prefetch record pointer fields that the recursive call "
+             "chain actually accesses"));
+
+static cl::opt<unsigned> CacheLineSize(
+    "greedy-prefetch-cache-line", cl::init(0),
+    cl::desc("Cache line size in bytes used to place prefetches (0 = ask the "
+             "target, falling back to 64)"));
+
+static cl::opt<unsigned> MaxLinesPerObject(
+    "greedy-prefetch-max-lines", cl::init(8),
+    cl::desc("Upper bound on the number of cache lines prefetched for one "
+             "pointed to object"));
+
+static cl::opt<bool> ProfileGuided(
+    "greedy-prefetch-pgo", cl::init(false),
+    cl::desc("Use profile block frequencies to skip prefetching children whose "
+             "recursive call sites are cold"));
+
+static cl::opt<double> HotCallRatio(
+    "greedy-prefetch-hot-ratio", cl::init(0.25),
+    cl::desc("A recursive call site is hot when its block runs at least this "
+             "many times per entry to the function"));
+
+static cl::opt<bool> CostModel(
+    "greedy-prefetch-cost-model", cl::init(false),
+    cl::desc("Choose the lookahead depth, jump pointers or no prefetching per "
+             "function by comparing the work before each recursive call "
+             "against the memory latency"));
+
+static cl::opt<unsigned> MemoryLatency(
+    "greedy-prefetch-memory-latency", cl::init(200),
+    cl::desc("Memory latency, in target cost model units, that a prefetch "
+             "needs to hide"));
+
+static cl::opt<unsigned> MaxModelDepth(
+    "greedy-prefetch-max-depth", cl::init(3),
+    cl::desc("Deepest lookahead the cost model will pick before switching "
+             "to jump pointers"));
+
+static cl::opt<bool> PrefetchHints(
+    "greedy-prefetch-hints", cl::init(true),
+    cl::desc("Pick the prefetch rw and locality hints from how the prefetched "
+             "object is used instead of always (read, locality 3)"));
+
+static cl::opt<unsigned> StreamingLocality(
+    "greedy-prefetch-streaming-locality", cl::init(0),
+    cl::desc("Locality hint (0-3) for objects a traversal visits only once"));
+
+static cl::opt<bool> RunInDefaultPipeline(
+    "greedy-prefetch-default-pipeline", cl::init(true),
+    cl::desc("Add the pass to the end of the default -O1/-O2/-O3 pipelines "
+             "when the plugin is loaded (e.g. clang -fpass-plugin)"));
+
+enum class LTOPhase { None, PreLink, PostLink };
+
+static cl::opt<LTOPhase> LTOPhaseOpt(
+    "greedy-prefetch-lto", cl::init(LTOPhase::None),
+    cl::desc("Where the pass runs in an LTO build"),
+    cl::values(
+        clEnumValN(LTOPhase::None, "none", "Not an LTO build, transform each module"),
+        clEnumValN(LTOPhase::PreLink, "pre-link",
+                   "Compile step: only export a summary of RDS field usage and calls"),
+        clEnumValN(LTOPhase::PostLink, "post-link",
+                   "Link step: merge the exported summaries, then transform")));
+
+static cl::opt<std::string> SummaryDir(
+    "greedy-prefetch-summary-dir", cl::init(""),
+    cl::desc("Directory pre-link writes per module summaries to and post-link "
+             "reads them from, needed for ThinLTO where modules are not merged"));
+
+static cl::opt<unsigned> MaxPrefetchesPerArgument(
+    "greedy-prefetch-max-per-arg", cl::init(64),
+    cl::desc("Upper bound on the number of prefetches emitted for a single "
+             "argument across all lookahead levels"));
 
 namespace {
 
-struct GreedyPrefetchPass : public PassInfoMixin<GreedyPrefetchPass> {  
+struct GreedyPrefetchPass : public PassInfoMixin<GreedyPrefetchPass> {  
+
+  /**
+   * Returns every call instruction that has an operand deriving from arg. Values
+   * are followed forward through their users, and a store of a derived value
+   * continues through the users of the slot it was stored to, which is how
+   * arguments reach calls in unoptimized code. Calls and returns end a chain.
+   * Each value is visited once, so this is linear in the size of the function.
+  */
+  std::set<CallInst*> getCallsDerivedFromArgument(Argument* arg) {
+    std::set<CallInst*> calls;
+    SmallPtrSet<Value*, 32> visited;
+    std::vector<Value*> worklist = {arg};
+    visited.insert(arg);
+    while (!worklist.empty()) {
+      Value* val = worklist.back();
+      worklist.pop_back();
+      for (auto* user : val->users()) {
+        if (auto* callInst = dyn_cast<CallInst>(user)) {
+          calls.insert(callInst);
+          continue;
+        }
+        if (isa<ReturnInst>(user)) {
+          continue;
+        }
+        Value* next = user;
+        if (auto* storeInst = dyn_cast<StoreInst>(user)) {
+          //storing through val doesn't make the slot derive from it
+          if (storeInst->getValueOperand() != val) {
+            continue;
+          }
+          next = storeInst->getPointerOperand();
+        }
+        if (visited.insert(next).second) {
+          worklist.push_back(next);
+        }
+      }
+    }
+    return calls;
+  }
+
+  /****
+   * Returns a vector of call instructions within a given function that call back
+   * into its call graph SCC, i.e. direct, mutual and longer chain recursion
+  */
+  std::vector<CallInst*> getRecursiveCalls(Function& F, const std::vector<Function*>& scc) {
+    std::vector<CallInst*> res;
+    for (auto& bb: F){
+      for (auto& instr: bb){
+        if (auto* callInst = dyn_cast<CallInst>(&instr)) {
+          if (auto* calledFunction = callInst->getCalledFunction()) {
+            if (std::find(scc.begin(), scc.end(), calledFunction) != scc.end()){
+              res.push_back(callInst);
+            }
+          }
+        }
+      }
+    }
+    return res;
+  }
+
+  /***
+   * Returns the call graph SCCs of the module that contain recursion: more than one
+   * function, or a single function that calls itself. Computed once per module so
+   * the cost stays linear in the size of the call graph.
+  ***/
+  std::vector<std::vector<Function*>> getRecursiveSCCs(CallGraph& CG) {
+    std::vector<std::vector<Function*>> res;
+    for (auto scc = scc_begin(&CG); !scc.isAtEnd(); ++scc) {
+      if (!scc.hasCycle()) {
+        continue;
+      }
+      std::vector<Function*> functions;
+      for (CallGraphNode* node : *scc) {
+        Function* fn = node->getFunction();
+        if (fn && !fn->isDeclaration()) {
+          functions.push_back(fn);
+        }
+      }
+      if (!functions.empty()) {
+        res.push_back(std::move(functions));
+      }
+    }
+    return res;
+  }
+
+  //generate one of these structs for every element we want to prefetch
+  struct PrefetchInfo {
+    std::vector<size_t>  gepOffsets;
+    PointerType* structPointerType; //type of the member we load, a pointer to the struct that we are prefetching
+    StructType* pointeeType;        //the struct that we are prefetching
+    int countField = -1;            //for a child array, the member holding how many slots are in use
+    GlobalVariable* compressedPool = nullptr; //the region pool a compressed link is an index into
+  };
+
+  /***
+   * RDS type recovery. With opaque pointers a pointer type no longer says what it
+   * points to, so the struct behind a pointer is recovered from how it is used: the
+   * source element type of the GEPs based on it, followed through casts, phis,
+   * spill slots, struct members and calls into defined functions, and failing that
+   * from the debug info. This works the same on typed pointer IR.
+  */
+  //loads and stores of pointers held in a struct member, by (struct, top level member)
+  std::map<std::pair<StructType*, size_t>, std::vector<Instruction*>> fieldAccesses;
+  //recovered pointee of a struct member, nullptr while being computed or if unknown
+  std::map<std::pair<StructType*, size_t>, StructType*> fieldPointeeTypes;
+  std::unordered_map<Argument*, StructType*> argumentTypes;
+  //debug info struct definitions by struct or typedef name
+  std::map<std::string, DICompositeType*> debugStructs;
+
+  /***
+   * Indexes the module once: which instructions load or store each pointer member,
+   * and the debug info composite types by name
+  */
+  void buildTypeRecoveryIndex(Module& M) {
+    fieldAccesses.clear();
+    fieldPointeeTypes.clear();
+    argumentTypes.clear();
+    debugStructs.clear();
+    for (auto& fn : M) {
+      for (auto& bb : fn) {
+        for (auto& instr : bb) {
+          auto* gep = dyn_cast<GetElementPtrInst>(&instr);
+          auto* structType = gep ? dyn_cast<StructType>(gep->getSourceElementType()) : nullptr;
+          if (!structType || gep->getNumIndices() < 2) {
+            continue;
+          }
+          size_t field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+          for (auto* user : gep->users()) {
+            if (auto* load = dyn_cast<LoadInst>(user)) {
+              if (load->getType()->isPointerTy()) {
+                fieldAccesses[{structType, field}].push_back(load);
+              }
+            } else if (auto* store = dyn_cast<StoreInst>(user)) {
+              if (store->getPointerOperand() == gep && store->getValueOperand()->getType()->isPointerTy()) {
+                fieldAccesses[{structType, field}].push_back(store);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    DebugInfoFinder finder;
+    finder.processModule(M);
+    for (DIType* type : finder.types()) {
+      if (auto* typedefType = dyn_cast<DIDerivedType>(type)) {
+        if (typedefType->getTag() == dwarf::DW_TAG_typedef) {
+          if (auto* composite = dyn_cast_or_null<DICompositeType>(typedefType->getBaseType())) {
+            debugStructs.insert({typedefType->getName().str(), composite});
+          }
+        }
+      } else if (auto* composite = dyn_cast<DICompositeType>(type)) {
+        if (composite->getTag() == dwarf::DW_TAG_structure_type && !composite->getName().empty()) {
+          debugStructs[composite->getName().str()] = composite;
+        }
+      }
+    }
+  }
+
+  /***
+   * Returns the IR struct that a debug info type points to (through typedefs,
+   * qualifiers and, for arrays of pointers, the array), if there is one
+  */
+  StructType* getStructTypeFromDebugInfo(DIType* type, LLVMContext& context) {
+    bool sawPointer = false;
+    std::string name;
+    while (type) {
+      if (auto* composite = dyn_cast<DICompositeType>(type)) {
+        if (composite->getTag() == dwarf::DW_TAG_array_type) {
+          type = composite->getBaseType();
+          continue;
+        }
+        if (!sawPointer || composite->getTag() != dwarf::DW_TAG_structure_type) {
+          return nullptr;
+        }
+        if (!composite->getName().empty()) {
+          name = composite->getName().str();
+        }
+        //clang names C structs struct.<tag>, or struct.<typedef> when anonymous
+        return name.empty() ? nullptr : StructType::getTypeByName(context, "struct." + name);
+      }
+      auto* derived = dyn_cast<DIDerivedType>(type);
+      if (!derived) {
+        return nullptr;
+      }
+      if (derived->getTag() == dwarf::DW_TAG_pointer_type) {
+        if (sawPointer) {
+          return nullptr;
+        }
+        sawPointer = true;
+      } else if (derived->getTag() == dwarf::DW_TAG_typedef && sawPointer) {
+        name = derived->getName().str();
+      }
+      type = derived->getBaseType();
+    }
+    return nullptr;
+  }
+
+  /***
+   * Returns the struct that v points to, judging by how v and the values it flows
+   * into are used
+  */
+  StructType* getPointeeStructType(Value* v) {
+    SmallPtrSet<Value*, 16> visited;
+    return inferPointeeStructType(v, visited, true);
+  }
+
+  StructType* inferPointeeStructType(Value* v, SmallPtrSet<Value*, 16>& visited, bool lookThroughMembers) {
+    if (!v->getType()->isPointerTy() || !visited.insert(v).second) {
+      return nullptr;
+    }
+    for (auto* user : v->users()) {
+      StructType* found = nullptr;
+      if (auto* gep = dyn_cast<GetElementPtrInst>(user)) {
+        if (gep->getPointerOperand() == v) {
+          found = dyn_cast<StructType>(gep->getSourceElementType());
+        }
+      } else if (isa<BitCastInst>(user) || isa<AddrSpaceCastInst>(user) || isa<PHINode>(user) ||
+                 isa<SelectInst>(user)) {
+        found = inferPointeeStructType(user, visited, lookThroughMembers);
+      } else if (auto* store = dyn_cast<StoreInst>(user)) {
+        if (store->getValueOperand() != v) {
+          continue;
+        }
+        Value* slot = store->getPointerOperand()->stripPointerCasts();
+        if (isa<AllocaInst>(slot)) {
+          //reloads of a spill slot hold the same pointer
+          for (auto* slotUser : slot->users()) {
+            if (auto* reload = dyn_cast<LoadInst>(slotUser)) {
+              if ((found = inferPointeeStructType(reload, visited, lookThroughMembers))) {
+                break;
+              }
+            }
+          }
+        } else if (auto* gep = dyn_cast<GetElementPtrInst>(slot)) {
+          auto* structType = dyn_cast<StructType>(gep->getSourceElementType());
+          if (lookThroughMembers && structType && gep->getNumIndices() >= 2) {
+            found = getFieldPointeeType(structType, cast<ConstantInt>(gep->getOperand(2))->getZExtValue());
+          }
+        }
+      } else if (auto* call = dyn_cast<CallInst>(user)) {
+        Function* callee = call->getCalledFunction();
+        if (callee && !callee->isDeclaration() && !callee->isVarArg()) {
+          for (unsigned i = 0; i < call->arg_size() && !found; ++i) {
+            if (call->getArgOperand(i) == v) {
+              found = inferPointeeStructType(callee->getArg(i), visited, lookThroughMembers);
+            }
+          }
+        }
+      }
+      if (found) {
+        return found;
+      }
+    }
+
+    //nothing downstream says, ask where the value came from
+    if (auto* load = dyn_cast<LoadInst>(v)) {
+      auto* gep = dyn_cast<GetElementPtrInst>(load->getPointerOperand()->stripPointerCasts());
+      auto* structType = gep ? dyn_cast<StructType>(gep->getSourceElementType()) : nullptr;
+      if (lookThroughMembers && structType && gep->getNumIndices() >= 2) {
+        return getFieldPointeeType(structType, cast<ConstantInt>(gep->getOperand(2))->getZExtValue());
+      }
+    }
+    if (isa<PHINode>(v) || isa<SelectInst>(v)) {
+      for (Value* incoming : cast<Instruction>(v)->operands()) {
+        if (auto* found = inferPointeeStructType(incoming, visited, lookThroughMembers)) {
+          return found;
+        }
+      }
+    }
+    //a node handed back by a constructor, e.g. t->l = TreeAlloc(level - 1)
+    if (auto* call = dyn_cast<CallInst>(v)) {
+      Function* callee = call->getCalledFunction();
+      if (callee && !callee->isDeclaration()) {
+        for (auto& bb : *callee) {
+          auto* ret = dyn_cast<ReturnInst>(bb.getTerminator());
+          if (ret && ret->getReturnValue()) {
+            if (auto* found = inferPointeeStructType(ret->getReturnValue(), visited, lookThroughMembers)) {
+              return found;
+            }
+          }
+        }
+      }
+    }
+    if (auto* arg = dyn_cast<Argument>(v)) {
+      if (DISubprogram* sp = arg->getParent()->getSubprogram()) {
+        auto types = sp->getType()->getTypeArray();
+        if (arg->getArgNo() + 1 < types.size()) {
+          return getStructTypeFromDebugInfo(types[arg->getArgNo() + 1], arg->getContext());
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  /***
+   * Returns the struct pointed to by the pointers stored in the given member (or in
+   * every element of it, for an array of pointers)
+  */
+  StructType* getFieldPointeeType(StructType* structType, size_t field) {
+    auto key = std::make_pair(structType, field);
+    auto cached = fieldPointeeTypes.find(key);
+    if (cached != fieldPointeeTypes.end()) {
+      return cached->second;
+    }
+    //members that point at each other would otherwise recurse forever
+    fieldPointeeTypes[key] = nullptr;
+
+    StructType* found = nullptr;
+    for (auto* access : fieldAccesses[key]) {
+      SmallPtrSet<Value*, 16> visited;
+      if (auto* store = dyn_cast<StoreInst>(access)) {
+        found = inferPointeeStructType(store->getValueOperand(), visited, false);
+      } else {
+        found = inferPointeeStructType(access, visited, false);
+      }
+      if (found) {
+        break;
+      }
+    }
+    if (!found && structType->hasName() && structType->getName().startswith("struct.")) {
+      auto composite = debugStructs.find(structType->getName().drop_front(7).str());
+      if (composite != debugStructs.end()) {
+        std::vector<DIDerivedType*> members;
+        for (auto* element : composite->second->getElements()) {
+          auto* member = dyn_cast<DIDerivedType>(element);
+          if (member && member->getTag() == dwarf::DW_TAG_member && !member->isStaticMember()) {
+            members.push_back(member);
+          }
+        }
+        //padding or bitfields break the member to field mapping
+        if (members.size() == structType->getNumElements()) {
+          found = getStructTypeFromDebugInfo(members[field]->getBaseType(), structType->getContext());
+        }
+      }
+    }
+    //the pointer may only be followed in another module of an LTO build
+    if (!found && structType->hasName()) {
+      auto summarised = summaryPointeeTypes.find({structType->getName().str(), field});
+      if (summarised == summaryPointeeTypes.end()) {
+        summarised = summaryPointeeTypes.find({stripNumericSuffix(structType->getName()).str(), field});
+      }
+      if (summarised != summaryPointeeTypes.end()) {
+        found = getSummaryStructType(summarised->second, structType->getContext());
+      }
+    }
+    fieldPointeeTypes[key] = found;
+    return found;
+  }
+
+  /***
+   * Returns the struct an argument points to, or nullptr if it isn't a struct pointer
+  */
+  StructType* getArgumentStructType(Argument* arg) {
+    auto cached = argumentTypes.find(arg);
+    if (cached != argumentTypes.end()) {
+      return cached->second;
+    }
+    StructType* structType = getPointeeStructType(arg);
+    argumentTypes[arg] = structType;
+    return structType;
+  }
+
+  /***
+    * Returns the offsets of every record pointer member of the given struct
+  ***/
+  std::vector<PrefetchInfo> getPrefetchInfoForStruct(StructType* innerType) {
+    std::vector<PrefetchInfo> offsets;
+    if (innerType->isOpaque()) {
+      return offsets;
+    }
+    for (size_t i = 0; i < innerType->getNumElements(); ++i) {
+      //if T = {T0 a, T1 b, ..., TN z} then argumentFieldType is Ti
+      auto* argumentFieldType = innerType->getTypeAtIndex(i);
+      auto bound = arrayBounds.find({innerType, i});
+      //case 4 links compressed to indices, or an array of them
+      auto compressed = compressedLinks.find({innerType, i});
+      if (compressed != compressedLinks.end()) {
+        auto* array = dyn_cast<ArrayType>(argumentFieldType);
+        for (size_t j = 0; j < (array ? array->getNumElements() : 1); ++j) {
+          std::vector<size_t> gepOffsets = array ? std::vector<size_t>{i, j} : std::vector<size_t>{i};
+          offsets.push_back({gepOffsets, innerType->getPointerTo(), innerType, -1, compressed->second});
+        }
+        continue;
+      }
+      //case 1 we have a direct  pointer to a struct
+      if (auto* argumentFieldPtrType = dyn_cast<PointerType>(argumentFieldType)) {
+        if (auto* fieldInnerType = getFieldPointeeType(innerType, i)) {
+          offsets.push_back({{i}, argumentFieldPtrType, fieldInnerType});
+        } else if (bound != arrayBounds.end()) {
+          //case 3 a pointer to a heap array of pointers to structs, walked up to a count member
+          auto [elementType, elementPointeeType] = getHeapArrayElementType(innerType, i);
+          if (elementPointeeType) {
+            offsets.push_back({{i}, elementType, elementPointeeType, (int)bound->second});
+          }
+        }
+      }
+      //case 2 we have an array of pointers to structs
+      if (auto* argumentFieldArayType = dyn_cast<ArrayType>(argumentFieldType)){
+        if (auto* argumentFieldArrayElementType = dyn_cast<PointerType>(argumentFieldArayType->getElementType())){
+          if (auto* argumentFieldArrayElementPointeeType = getFieldPointeeType(innerType, i)){
+            //only the slots below the count are initialized, prefetch those with a loop
+            if (bound != arrayBounds.end()) {
+              offsets.push_back({{i}, argumentFieldArrayElementType, argumentFieldArrayElementPointeeType,
+                                 (int)bound->second});
+              continue;
+            }
+            //push a new PrefetchInfo for each element of the array
+            for (size_t j = 0; j < argumentFieldArayType->getNumElements(); ++j){
+              offsets.push_back({{i, j}, argumentFieldArrayElementType, argumentFieldArrayElementPointeeType});
+            }
+          }
+        }
+      }
+    }
+    return offsets;
+  }
+
+  //which members of a struct type the analysed functions access
+  struct FieldUsage {
+    std::set<size_t> fields;                            //top level member indices
+    std::set<std::pair<size_t, size_t>> arrayElements;  //constant indexed array members
+    std::set<size_t> dynamicArrays;                     //arrays indexed by a variable
+    std::set<size_t> storedFields;                      //top level members written to
+  };
+  std::unordered_map<StructType*, FieldUsage> fieldUsage;
+
+  /***
+   * Records every struct member that a GEP in the given functions addresses. This is
+   * type based rather than following the argument, so it sees through the allocas
+   * of unoptimized code, and it is conservative: a member used anywhere in the
+   * recursive call chain counts as used for every node of that type.
+  */
+  void computeFieldUsage(std::vector<Function*>& functions) {
+    fieldUsage.clear();
+    for (Function* fn : functions) {
+      for (auto& bb : *fn) {
+        for (auto& instr : bb) {
+          auto* gep = dyn_cast<GetElementPtrInst>(&instr);
+          if (!gep || gep->use_empty() || gep->getNumIndices() < 2) {
+            continue;
+          }
+          auto* structType = dyn_cast<StructType>(gep->getSourceElementType());
+          if (!structType) {
+            continue;
+          }
+          size_t field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+          FieldUsage& usage = fieldUsage[structType];
+          usage.fields.insert(field);
+          for (auto* user : gep->users()) {
+            if (auto* store = dyn_cast<StoreInst>(user)) {
+              if (store->getPointerOperand() == gep) {
+                usage.storedFields.insert(field);
+              }
+            }
+          }
+          if (gep->getNumIndices() >= 3 && isa<ArrayType>(structType->getElementType(field))) {
+            if (auto* element = dyn_cast<ConstantInt>(gep->getOperand(3))) {
+              usage.arrayElements.insert({field, element->getZExtValue()});
+            } else {
+              usage.dynamicArrays.insert(field);
+            }
+          } else if (gep->getNumIndices() == 2 && isa<ArrayType>(structType->getElementType(field))) {
+            //the array decayed to a pointer, any element may be reached through it
+            usage.dynamicArrays.insert(field);
+          }
+        }
+      }
+    }
+  }
+
+  //child arrays walked up to a count member: (struct, array member) -> count member
+  std::map<std::pair<StructType*, size_t>, size_t> arrayBounds;
+
+  /***
+   * Returns what a loop counter is derived from, looking through casts and constant
+   * steps: the induction phi in SSA form, or the stack slot it lives in at -O0
+  */
+  Value* getCounterBase(Value* v) {
+    while (true) {
+      if (auto* cast = dyn_cast<CastInst>(v)) {
+        v = cast->getOperand(0);
+      } else if (auto* binary = dyn_cast<BinaryOperator>(v);
+                 binary && (binary->getOpcode() == Instruction::Add || binary->getOpcode() == Instruction::Sub) &&
+                 isa<ConstantInt>(binary->getOperand(1))) {
+        v = binary->getOperand(0);
+      } else if (auto* load = dyn_cast<LoadInst>(v); load && isa<AllocaInst>(load->getPointerOperand())) {
+        return load->getPointerOperand();
+      } else {
+        return v;
+      }
+    }
+  }
+
+  /***
+   * Returns the integer member of structType that v is loaded from
+  */
+  std::optional<size_t> getLoadedCountField(Value* v, StructType* structType) {
+    while (auto* cast = dyn_cast<CastInst>(v)) {
+      v = cast->getOperand(0);
+    }
+    auto* load = dyn_cast<LoadInst>(v);
+    auto* gep = load ? dyn_cast<GetElementPtrInst>(load->getPointerOperand()->stripPointerCasts()) : nullptr;
+    if (!gep || gep->getSourceElementType() != structType || gep->getNumIndices() != 2) {
+      return std::nullopt;
+    }
+    size_t field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+    if (!structType->getElementType(field)->isIntegerTy()) {
+      return std::nullopt;
+    }
+    return field;
+  }
+
+  /***
+   * Returns the variable indexes the given struct member is indexed with: the array
+   * index of a pointer array member, or of the heap array a pointer member points to
+  */
+  std::vector<Value*> getChildArrayIndexes(GetElementPtrInst* gep, StructType* structType, size_t field) {
+    std::vector<Value*> indexes;
+    Type* fieldType = structType->getElementType(field);
+    auto* arrayType = dyn_cast<ArrayType>(fieldType);
+    if (arrayType && arrayType->getElementType()->isPointerTy() && gep->getNumIndices() >= 3 &&
+        !isa<ConstantInt>(gep->getOperand(3))) {
+      indexes.push_back(gep->getOperand(3));
+    }
+    if (!fieldType->isPointerTy() || gep->getNumIndices() != 2) {
+      return indexes;
+    }
+    for (auto* user : gep->users()) {
+      auto* array = dyn_cast<LoadInst>(user);
+      if (!array || array->getPointerOperand() != gep) {
+        continue;
+      }
+      for (auto* arrayUser : array->users()) {
+        auto* element = dyn_cast<GetElementPtrInst>(arrayUser);
+        if (element && element->getPointerOperand() == array && element->getNumIndices() == 1 &&
+            element->getSourceElementType()->isPointerTy() && !isa<ConstantInt>(element->getOperand(1))) {
+          indexes.push_back(element->getOperand(1));
+        }
+      }
+    }
+    return indexes;
+  }
+
+  /***
+   * Finds child arrays, fixed size members or pointers to heap arrays, that the given
+   * functions index with a loop counter which is compared against an integer member
+   * of the same struct, as in for (i = 0; i < n->numChildren; ++i) f(n->children[i]).
+   * Only the slots below that count are in use.
+  */
+  void computeArrayBounds(std::vector<Function*>& functions) {
+    arrayBounds.clear();
+    if (!BoundedArrays) {
+      return;
+    }
+    for (Function* fn : functions) {
+      //the loop exit tests of the function: counter base -> the value it is compared to
+      std::vector<std::pair<Value*, Value*>> exitTests;
+      for (auto& bb : *fn) {
+        auto* branch = dyn_cast<BranchInst>(bb.getTerminator());
+        auto* compare = branch && branch->isConditional() ? dyn_cast<ICmpInst>(branch->getCondition()) : nullptr;
+        if (compare) {
+          exitTests.push_back({getCounterBase(compare->getOperand(0)), compare->getOperand(1)});
+          exitTests.push_back({getCounterBase(compare->getOperand(1)), compare->getOperand(0)});
+        }
+      }
+      for (auto& bb : *fn) {
+        for (auto& instr : bb) {
+          auto* gep = dyn_cast<GetElementPtrInst>(&instr);
+          auto* structType = gep ? dyn_cast<StructType>(gep->getSourceElementType()) : nullptr;
+          if (!structType || gep->getNumIndices() < 2) {
+            continue;
+          }
+          size_t field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+          for (Value* index : getChildArrayIndexes(gep, structType, field)) {
+            Value* counter = getCounterBase(index);
+            for (auto& [testCounter, bound] : exitTests) {
+              if (testCounter != counter) {
+                continue;
+              }
+              if (auto countField = getLoadedCountField(bound, structType)) {
+                arrayBounds[{structType, field}] = *countField;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /***
+   * Returns the element pointer type and pointee struct of the heap array that a
+   * pointer member points to, e.g. node_t* and node_t for node_t** to_nodes
+  */
+  std::pair<PointerType*, StructType*> getHeapArrayElementType(StructType* structType, size_t field) {
+    for (auto* access : fieldAccesses[{structType, field}]) {
+      auto* array = dyn_cast<LoadInst>(access);
+      if (!array) {
+        continue;
+      }
+      for (auto* user : array->users()) {
+        auto* element = dyn_cast<GetElementPtrInst>(user);
+        auto* elementType = element ? dyn_cast<PointerType>(element->getSourceElementType()) : nullptr;
+        if (!elementType || element->getPointerOperand() != array) {
+          continue;
+        }
+        for (auto* elementUser : element->users()) {
+          if (auto* child = dyn_cast<LoadInst>(elementUser)) {
+            SmallPtrSet<Value*, 16> visited;
+            if (auto* pointee = inferPointeeStructType(child, visited, false)) {
+              return {elementType, pointee};
+            }
+          }
+        }
+      }
+    }
+    return {nullptr, nullptr};
+  }
+
+  /***
+   * Returns the record pointer members of the struct that the analysed functions
+   * load and whose pointee they go on to access
+  */
+  std::vector<PrefetchInfo> getUsedPrefetchInfoForStruct(StructType* structType) {
+    std::vector<PrefetchInfo> offsets = getPrefetchInfoForStruct(structType);
+    if (!UsedFieldsOnly) {
+      return offsets;
+    }
+    std::vector<PrefetchInfo> used;
+    auto usage = fieldUsage.find(structType);
+    if (usage == fieldUsage.end()) {
+      return used;
+    }
+    for (auto& info : offsets) {
+      size_t field = info.gepOffsets[0];
+      if (!usage->second.fields.count(field)) {
+        continue;
+      }
+      if (info.gepOffsets.size() > 1 && !usage->second.dynamicArrays.count(field) &&
+          !usage->second.arrayElements.count({field, info.gepOffsets[1]})) {
+        continue;
+      }
+      //a pointer we only ever copy around is not worth fetching the target of
+      if (!fieldUsage.count(info.pointeeType)) {
+        continue;
+      }
+      used.push_back(info);
+    }
+    return used;
+  }
+
+  /***
+    * Returns a map from argument of function args to offsets of record pointer members
+  ***/
+  std::unordered_map<Value*, std::vector<PrefetchInfo>> getPrefetchInfoForArguments(Function &F) {
+    /***
+      * For each function arg typ
+      *   if type dyncasts to struct ptr
+      *     For each member type of arg
+      *       if member type dyncasts to struct ptr
+      *         add offset to result vector
+    ***/
+    std::unordered_map<Value*, std::vector<PrefetchInfo>> offsets;
+
+    auto arglist = F.args();
+    
+    for (auto* a = arglist.begin(); a != arglist.end(); ++a){
+      if (isa<PointerType>(a->getType())) {
+        if (auto* innerType = getArgumentStructType(a)) {
+          //innerType is the if we have T* a as an arg then inner type is T
+          std::vector<PrefetchInfo> argOffsets = getUsedPrefetchInfoForStruct(innerType);
+          if (!argOffsets.empty()) {
+            offsets[a] = std::move(argOffsets);
+          }
+        }
+      }
+    }
+    return offsets;
+  }
+
+  //how prefetching is done for one function
+  struct PrefetchPlan {
+    unsigned depth;       //levels of greedy lookahead, 0 = don't prefetch
+    bool jumpPointers;
+    unsigned jumpDistance;
+    std::vector<size_t> firstVisited; //member recursed into first, empty if unknown
+    std::set<std::vector<size_t>> descent; //members a search descent picks from, empty if not one
+  };
+
+  PrefetchPlan getDefaultPlan() {
+    return {std::max(1u, (unsigned)PrefetchDepth), JumpPointerPrefetch, std::max(1u, (unsigned)JumpPointerDistance),
+            {}, {}};
+  }
+
+  /***
+   * Returns the target's latency estimate for the instructions of bb up to (but
+   * not including) until, or the whole block when until is null
+  */
+  uint64_t getBlockCost(BasicBlock& bb, TargetTransformInfo& TTI, Instruction* until = nullptr) {
+    uint64_t cost = 0;
+    for (auto& ins : bb){
+      if (&ins == until) {
+        break;
+      }
+      InstructionCost c = TTI.getInstructionCost(&ins, TargetTransformInfo::TCK_Latency);
+      cost += c.isValid() ? *c.getValue() : 1;
+    }
+    return cost;
+  }
+
+  /***
+   * Estimates the work done before each recursive call and the work done per node,
+   * then picks the shallowest lookahead that issues the prefetch about a memory
+   * latency ahead of the visit. Descending d levels buys roughly (d - 1) nodes
+   * worth of work on top of the work before the first call. If that needs more
+   * than the maximum depth, recursive structs switch to jump pointers and others
+   * are left alone, since in-line prefetches would then only add overhead.
+  */
+  PrefetchPlan getCostModelPlan(Function& F, std::vector<CallInst*>& calls, StructType* argType,
+                                TargetTransformInfo& TTI, DominatorTree& DT) {
+    PrefetchPlan plan = getDefaultPlan();
+    std::set<Instruction*> recursive(calls.begin(), calls.end());
+
+    uint64_t nodeWork = 0;
+    for (auto& bb : F) {
+      for (auto& ins : bb) {
+        if (!recursive.count(&ins)) {
+          InstructionCost c = TTI.getInstructionCost(&ins, TargetTransformInfo::TCK_Latency);
+          nodeWork += c.isValid() ? *c.getValue() : 1;
+        }
+      }
+    }
+
+    //a call preceded by another recursive call has a whole subtree to hide behind
+    uint64_t minWorkBeforeCall = UINT64_MAX;
+    for (auto* call : calls) {
+      uint64_t work = getBlockCost(*call->getParent(), TTI, call);
+      bool afterSubtree = false;
+      for (auto& bb : F) {
+        if (&bb != call->getParent() && DT.dominates(&bb, call->getParent())) {
+          work += getBlockCost(bb, TTI);
+        }
+      }
+      for (auto* other : calls) {
+        if (other != call && DT.dominates(other, call)) {
+          afterSubtree = true;
+        }
+      }
+      if (!afterSubtree) {
+        minWorkBeforeCall = std::min(minWorkBeforeCall, work);
+      }
+    }
+
+    uint64_t latency = MemoryLatency;
+    if (minWorkBeforeCall >= latency) {
+      plan.depth = 1;
+      plan.jumpPointers = false;
+      return plan;
+    }
+    nodeWork = std::max<uint64_t>(1, nodeWork);
+    uint64_t depth = 1 + (latency - minWorkBeforeCall + nodeWork - 1) / nodeWork;
+    if (depth <= MaxModelDepth) {
+      plan.depth = depth;
+      plan.jumpPointers = false;
+    } else if (isRecursiveStruct(argType)) {
+      plan.depth = 1;
+      plan.jumpPointers = true;
+      plan.jumpDistance = (latency + nodeWork - 1) / nodeWork;
+    } else {
+      plan.depth = 0;
+    }
+    return plan;
+  }
+
+  //locality hint for the prefetches of the function being transformed
+  unsigned prefetchLocality = 3;
+
+  //the node may be an i8* whose struct was recovered through a bitcast, or, with typed
+  //pointers, still name the struct that splitting or reordering replaced
+  Value* castToStruct(IRBuilder<>& builder, Value* ptr, StructType* structType) {
+    return builder.CreateBitCast(ptr, structType->getPointerTo(ptr->getType()->getPointerAddressSpace()));
+  }
+
+  //the child held by the link member at address, decoded if links of its type are compressed
+  Value* loadChild(IRBuilder<>& builder, PrefetchInfo& info, Value* address, const Twine& name = "") {
+    if (!info.compressedPool) {
+      return builder.CreateLoad(info.structPointerType, address, name);
+    }
+    Value* index = builder.CreateLoad(builder.getInt32Ty(), address, name + ".index");
+    return decodeLink(builder, index, info.compressedPool, info.structPointerType);
+  }
+
+  /***
+  * Emits a data cache prefetch of ptr at the builder's insert point. A write
+  * prefetch asks for the line in exclusive state so the store that follows does
+  * not pay for a second, read for ownership, miss.
+  */
+  void emitPrefetch(IRBuilder<>& builder, Value* ptr, Function& F, bool write = false, unsigned locality = 3) {
+    LLVMContext& context = F.getContext();
+    Function* prefetchFunc = Intrinsic::getDeclaration(F.getParent(), Intrinsic::prefetch, ptr->getType());
+    // Prefetch address
+    // rw: 0 = read, 1 = write; locality: 0 = none (non-temporal) to 3 = high; 1 = data cache
+    std::vector<Value*> args = {
+        ptr,
+        ConstantInt::get(Type::getInt32Ty(context), write ? 1 : 0), // rw
+        ConstantInt::get(Type::getInt32Ty(context), locality), // locality
+        ConstantInt::get(Type::getInt32Ty(context), 1)  // cache type (data cache)
+    };
+    builder.CreateCall(prefetchFunc->getFunctionType(), prefetchFunc, args, "");
+  }
+
+  unsigned cacheLineSize = 64;
+
+  //one prefetch into an object, offset bytes from its start
+  struct PrefetchLine {
+    uint64_t offset;
+    bool write; //the callee stores to something on this line
+  };
+
+  /***
+   * Returns the byte offsets, relative to the start of an object of the given type,
+   * at which to prefetch so that every cache line holding an accessed member is
+   * requested exactly once. Objects are assumed to start on a line boundary when
+   * grouping members into lines, and each line is prefetched at its first accessed
+   * byte so that a lone member is always covered however the object is aligned.
+  */
+  std::vector<PrefetchLine> getPrefetchLines(StructType* structType, const DataLayout& DL) {
+    auto usage = fieldUsage.find(structType);
+    if (!UsedFieldsOnly || structType->isOpaque() || usage == fieldUsage.end()) {
+      bool write = usage != fieldUsage.end() && !usage->second.storedFields.empty();
+      return {{0, write}};
+    }
+    const StructLayout* layout = DL.getStructLayout(structType);
+    struct Range {
+      uint64_t begin, end; //[begin, end) in bytes
+      bool stored;
+    };
+    std::vector<Range> ranges;
+    for (size_t field : usage->second.fields) {
+      Type* fieldType = structType->getElementType(field);
+      uint64_t begin = layout->getElementOffset(field);
+      bool stored = usage->second.storedFields.count(field);
+      auto* arrayType = dyn_cast<ArrayType>(fieldType);
+      if (arrayType && !usage->second.dynamicArrays.count(field)) {
+        uint64_t elementSize = DL.getTypeAllocSize(arrayType->getElementType());
+        for (auto& [arrayField, element] : usage->second.arrayElements) {
+          if (arrayField == field) {
+            ranges.push_back({begin + element * elementSize, begin + (element + 1) * elementSize, stored});
+          }
+        }
+        continue;
+      }
+      ranges.push_back({begin, begin + std::max<uint64_t>(1, DL.getTypeStoreSize(fieldType)), stored});
+    }
+
+    std::map<uint64_t, PrefetchLine> lines; //line index -> first accessed byte in it
+    for (auto& range : ranges) {
+      for (uint64_t line = range.begin / cacheLineSize; line <= (range.end - 1) / cacheLineSize; ++line) {
+        uint64_t first = std::max(range.begin, line * cacheLineSize);
+        auto existing = lines.find(line);
+        if (existing == lines.end()) {
+          lines[line] = {first, range.stored};
+        } else {
+          existing->second.offset = std::min(existing->second.offset, first);
+          existing->second.write = existing->second.write || range.stored;
+        }
+      }
+    }
+    std::vector<PrefetchLine> offsets;
+    for (auto& [line, prefetch] : lines) {
+      if (offsets.size() == std::max(1u, (unsigned)MaxLinesPerObject)) {
+        break;
+      }
+      offsets.push_back(prefetch);
+    }
+    if (offsets.empty()) {
+      offsets.push_back({0, false});
+    }
+    return offsets;
+  }
+
+  /***
+   * Prefetches every cache line of the struct ptr points to that the analysed
+   * functions access, rather than just the line at its base address
+  */
+  void emitPrefetchLines(IRBuilder<>& builder, Value* ptr, StructType* structType, Function& F) {
+    if (!structType) {
+      emitPrefetch(builder, ptr, F, false, prefetchLocality);
+      return;
+    }
+    Type* i8 = Type::getInt8Ty(F.getContext());
+    Value* bytes = nullptr;
+    for (auto& line : getPrefetchLines(structType, F.getParent()->getDataLayout())) {
+      bool write = PrefetchHints && line.write;
+      if (line.offset == 0) {
+        emitPrefetch(builder, ptr, F, write, prefetchLocality);
+        continue;
+      }
+      if (!bytes) {
+        bytes = builder.CreateBitCast(ptr, Type::getInt8PtrTy(F.getContext()));
+      }
+      //a gep without inbounds, ptr may be null or dangling by the time we get here
+      emitPrefetch(builder, builder.CreateGEP(i8, bytes, builder.getInt64(line.offset)), F, write, prefetchLocality);
+    }
+  }
+
+  /***
+   * Returns true if the struct has a member that points back to the same struct
+   * type, either directly or through an array of pointers
+  */
+  bool isRecursiveStruct(StructType* structType) {
+    for (auto& info : getPrefetchInfoForStruct(structType)) {
+      if (info.pointeeType == structType) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //per traversal, per thread storage backing the jump pointers
+  struct JumpPointerState {
+    GlobalVariable* table;   //[2^bits x {i8*, i8*}] node -> node visited k steps later
+    GlobalVariable* history; //[k x i8*] ring of the last k visited nodes
+    GlobalVariable* cursor;  //i32 index of the oldest entry in history
+  };
+
+  /***
+   * Jump pointers can't live in the node itself without changing the struct type
+   * and every allocation size that depends on it, so they are kept in a direct
+   * mapped table keyed by node address instead. A stale or colliding entry only
+   * costs a useless prefetch, prefetches never fault.
+   * Every visit reads one entry and writes another, so each traversal gets its
+   * own thread local table, small enough by default (64KB) to stay in L2
+   * rather than adding two misses per node.
+  */
+  JumpPointerState getOrCreateJumpPointerState(Function& F, unsigned distance) {
+    Module& M = *F.getParent();
+    LLVMContext& context = M.getContext();
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    auto* entryType = StructType::get(context, {i8Ptr, i8Ptr});
+    auto* tableType = ArrayType::get(entryType, 1ull << getJumpTableBits());
+    auto* historyType = ArrayType::get(i8Ptr, distance);
+    auto* cursorType = Type::getInt32Ty(context);
+
+    auto getOrCreate = [&](StringRef name, Type* type) {
+      if (auto* existing = M.getGlobalVariable(name, true)) {
+        return existing;
+      }
+      auto* global = new GlobalVariable(M, type, false, GlobalValue::InternalLinkage,
+                                        Constant::getNullValue(type), name);
+      global->setThreadLocal(true);
+      return global;
+    };
+    std::string suffix = "." + F.getName().str() + "." + std::to_string(distance);
+    return {getOrCreate("__greedy_prefetch_jump_table" + suffix, tableType),
+            getOrCreate("__greedy_prefetch_jump_history" + suffix, historyType),
+            getOrCreate("__greedy_prefetch_jump_cursor" + suffix, cursorType)};
+  }
+
+  unsigned getJumpTableBits() {
+    return std::min(20u, std::max(4u, (unsigned)JumpPointerTableBits));
+  }
+
+  /***
+   * Returns a pointer to the jump table entry for the node at address ptr
+  */
+  Value* getJumpTableEntry(IRBuilder<>& builder, JumpPointerState& state, Value* ptr) {
+    LLVMContext& context = builder.getContext();
+    Type* i64 = Type::getInt64Ty(context);
+    unsigned bits = getJumpTableBits();
+    //nodes are at least 16 byte aligned, fold the high bits in so neighbouring pages spread out
+    Value* addr = builder.CreatePtrToInt(ptr, i64);
+    Value* hash = builder.CreateXor(builder.CreateLShr(addr, 4), builder.CreateLShr(addr, 4 + bits));
+    Value* index = builder.CreateAnd(hash, ConstantInt::get(i64, (1ull << bits) - 1));
+    Value* zero = ConstantInt::get(i64, 0);
+    return builder.CreateInBoundsGEP(state.table->getValueType(), state.table, {zero, index}, "jp.entry");
+  }
+
+  /***
+   * Prefetches through the jump pointer recorded for node on an earlier traversal,
+   * then records node as the jump target of the node visited k steps ago
+  */
+  void emitJumpPointerPrefetch(IRBuilder<>& builder, Value* node, StructType* nodeType, unsigned distance,
+                               BasicBlock* insertBefore, Function& F) {
+    LLVMContext& context = F.getContext();
+    JumpPointerState state = getOrCreateJumpPointerState(F, distance);
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    Type* i32 = Type::getInt32Ty(context);
+    Type* entryType = cast<ArrayType>(state.table->getValueType())->getElementType();
+    Value* zero = ConstantInt::get(i32, 0);
+    Value* one = ConstantInt::get(i32, 1);
+    Value* nullValue = ConstantPointerNull::get(cast<PointerType>(i8Ptr));
+
+    //prefetch through the jump pointer if the entry belongs to this node
+    Value* node8 = builder.CreateBitCast(node, i8Ptr);
+    Value* entry = getJumpTableEntry(builder, state, node8);
+    Value* key = builder.CreateLoad(i8Ptr, builder.CreateInBoundsGEP(entryType, entry, {zero, zero}), "jp.key");
+    Value* jumpAddr = builder.CreateInBoundsGEP(entryType, entry, {zero, one});
+    Value* jump = builder.CreateLoad(i8Ptr, jumpAddr, "jp.target");
+    BasicBlock* prefetchBlock = BasicBlock::Create(context, "jump-prefetch", &F, insertBefore);
+    BasicBlock* recordBlock = BasicBlock::Create(context, "jump-record", &F, insertBefore);
+    builder.CreateCondBr(builder.CreateICmpEQ(key, node8), prefetchBlock, recordBlock);
+    builder.SetInsertPoint(prefetchBlock);
+    //jump pointers only pay off when the structure is walked again, keep it cached
+    bool write = PrefetchHints && fieldUsage.count(nodeType) && !fieldUsage[nodeType].storedFields.empty();
+    emitPrefetch(builder, jump, F, write, 3);
+    builder.CreateBr(recordBlock);
+
+    //push node into the history ring and pop the node visited k steps ago
+    builder.SetInsertPoint(recordBlock);
+    auto* historyType = cast<ArrayType>(state.history->getValueType());
+    Value* cursor = builder.CreateLoad(i32, state.cursor, "jp.cursor");
+    Value* slot = builder.CreateInBoundsGEP(historyType, state.history, {zero, cursor});
+    Value* previous = builder.CreateLoad(i8Ptr, slot, "jp.previous");
+    builder.CreateStore(node8, slot);
+    Value* next = builder.CreateAdd(cursor, one);
+    Value* wrapped = builder.CreateICmpEQ(next, ConstantInt::get(i32, historyType->getNumElements()));
+    builder.CreateStore(builder.CreateSelect(wrapped, zero, next), state.cursor);
+
+    //the node visited k steps ago now knows where to prefetch next time
+    BasicBlock* updateBlock = BasicBlock::Create(context, "jump-update", &F, insertBefore);
+    BasicBlock* doneBlock = BasicBlock::Create(context, "jump-done", &F, insertBefore);
+    builder.CreateCondBr(builder.CreateICmpNE(previous, nullValue), updateBlock, doneBlock);
+    builder.SetInsertPoint(updateBlock);
+    Value* previousEntry = getJumpTableEntry(builder, state, previous);
+    builder.CreateStore(previous, builder.CreateInBoundsGEP(entryType, previousEntry, {zero, zero}));
+    builder.CreateStore(node8, builder.CreateInBoundsGEP(entryType, previousEntry, {zero, one}));
+    builder.CreateBr(doneBlock);
+    builder.SetInsertPoint(doneBlock);
+  }
+
+  /***
+   * Loads the count member of a bounded child array as an i64, clamped to
+   * [0, array length] for fixed size arrays. A negative count means no children,
+   * whether the member is signed or not.
+  */
+  Value* emitChildCount(IRBuilder<>& builder, Value* node, StructType* eltT, PrefetchInfo& info) {
+    Type* i32 = builder.getInt32Ty();
+    Type* i64 = builder.getInt64Ty();
+    Value* countAddr = builder.CreateInBoundsGEP(eltT, castToStruct(builder, node, eltT), {builder.getInt32(0), ConstantInt::get(i32, info.countField)});
+    Value* count = builder.CreateLoad(eltT->getElementType(info.countField), countAddr, "child.count");
+    count = builder.CreateSExtOrTrunc(count, i64);
+    count = builder.CreateSelect(builder.CreateICmpSLT(count, ConstantInt::get(i64, 0)), ConstantInt::get(i64, 0),
+                                 count);
+    if (auto* arrayType = dyn_cast<ArrayType>(eltT->getElementType(info.gepOffsets[0]))) {
+      Value* length = ConstantInt::get(i64, arrayType->getNumElements());
+      count = builder.CreateSelect(builder.CreateICmpULT(count, length), count, length);
+    }
+    return count;
+  }
+
+  /***
+   * Emits a loop prefetching the children in slots [begin, end) of a child array,
+   * entered when nonEmpty holds. array is the loaded heap array, or null for a
+   * fixed size member of node. With childFields, the pointer members of
+   * each non null child are prefetched too. The builder is left in the exit block.
+  */
+  void emitArraySlotPrefetchLoop(IRBuilder<>& builder, Value* node, StructType* eltT, PrefetchInfo& info,
+                                 Value* array, Value* begin, Value* end, Value* nonEmpty,
+                                 std::vector<PrefetchInfo>* childFields, BasicBlock* insertBefore, Function& F) {
+    LLVMContext& context = F.getContext();
+    Type* i64 = builder.getInt64Ty();
+    BasicBlock* preheader = builder.GetInsertBlock();
+    BasicBlock* loop = BasicBlock::Create(context, "prefetch-array", &F, insertBefore);
+    BasicBlock* done = BasicBlock::Create(context, "prefetch-array-done", &F, insertBefore);
+    builder.CreateCondBr(nonEmpty, loop, done);
+
+    builder.SetInsertPoint(loop);
+    PHINode* index = builder.CreatePHI(i64, 2, "child.index");
+    index->addIncoming(begin, preheader);
+    Value* slot = array ? builder.CreateInBoundsGEP(info.structPointerType, array, index)
+                        : builder.CreateInBoundsGEP(eltT, castToStruct(builder, node, eltT), {builder.getInt32(0),
+                                                                 builder.getInt32(info.gepOffsets[0]), index});
+    Value* child = builder.CreateLoad(info.structPointerType, slot, "child");
+    emitPrefetchLines(builder, child, info.pointeeType, F);
+    if (childFields && !childFields->empty()) {
+      BasicBlock* fieldsBlock = BasicBlock::Create(context, "prefetch-array-fields", &F, done);
+      BasicBlock* latch = BasicBlock::Create(context, "prefetch-array-latch", &F, done);
+      builder.CreateCondBr(builder.CreateICmpNE(child, ConstantPointerNull::get(info.structPointerType)),
+                           fieldsBlock, latch);
+      builder.SetInsertPoint(fieldsBlock);
+      unsigned budget = MaxPrefetchesPerArgument;
+      emitPrefetchesForNode(builder, child, info.pointeeType, *childFields, 1, budget, latch, F);
+      builder.CreateBr(latch);
+      builder.SetInsertPoint(latch);
+    }
+    Value* next = builder.CreateAdd(index, ConstantInt::get(i64, 1));
+    index->addIncoming(next, builder.GetInsertBlock());
+    builder.CreateCondBr(builder.CreateICmpULT(next, end), loop, done);
+    builder.SetInsertPoint(done);
+  }
+
+  //bounded child arrays whose children are prefetched inside the loop that walks them
+  std::set<std::pair<StructType*, size_t>> pipelinedArrays;
+
+  /***
+   * Prefetches the children held in the in use slots of a child array, with a loop
+   * running up to the node's count member instead of one prefetch per slot. The
+   * count is clamped to the array length, or to -greedy-prefetch-max-array-prefetches
+   * for heap arrays, and the children are not descended into further. Arrays whose
+   * walking loop prefetches siblings itself only get their first child fetched here.
+  */
+  void emitBoundedArrayPrefetch(IRBuilder<>& builder, Value* node, StructType* eltT, PrefetchInfo& info,
+                                unsigned& budget, BasicBlock* insertBefore, Function& F) {
+    Type* i64 = builder.getInt64Ty();
+    size_t field = info.gepOffsets[0];
+    uint64_t limit = std::min<uint64_t>(MaxArrayPrefetches, budget);
+    if (pipelinedArrays.count({eltT, field})) {
+      limit = std::min<uint64_t>(limit, 1);
+    }
+    if (limit == 0) {
+      return;
+    }
+    budget -= limit;
+
+    Value* count = emitChildCount(builder, node, eltT, info);
+    Value* maxCount = ConstantInt::get(i64, limit);
+    count = builder.CreateSelect(builder.CreateICmpULT(count, maxCount), count, maxCount, "child.bound");
+    Value* hasChildren = builder.CreateICmpNE(count, ConstantInt::get(i64, 0));
+    Value* array = nullptr;
+    if (!isa<ArrayType>(eltT->getElementType(field))) {
+      auto* arrayPointerType = cast<PointerType>(eltT->getElementType(field));
+      array = builder.CreateLoad(arrayPointerType,
+                                 builder.CreateInBoundsGEP(eltT, castToStruct(builder, node, eltT), {builder.getInt32(0), builder.getInt32(field)}),
+                                 "child.array");
+      hasChildren = builder.CreateAnd(hasChildren, builder.CreateICmpNE(array, ConstantPointerNull::get(arrayPointerType)));
+    }
+    emitArraySlotPrefetchLoop(builder, node, eltT, info, array, ConstantInt::get(i64, 0), count, hasChildren,
+                              nullptr, insertBefore, F);
+  }
+
+  /***
+  * Loads each record pointer member of node and prefetches it. When there are
+  * levels of lookahead left, every loaded child is null checked and the same is
+  * done for its own record pointer members, so depth k prefetches k levels down.
+  * With onlyMembers, children of the same type as node only follow those members.
+  * The builder is left positioned at the end of the last block it emitted into.
+  */
+  void emitPrefetchesForNode(IRBuilder<>& builder, Value* node, StructType* eltT, std::vector<PrefetchInfo>& offsets,
+                             unsigned levelsLeft, unsigned& budget, BasicBlock* insertBefore, Function& F,
+                             const std::set<std::vector<size_t>>* onlyMembers = nullptr) {
+    LLVMContext& context = F.getContext();
+
+    Value* zero = ConstantInt::get(Type::getInt32Ty(context), 0);
+    std::vector<PrefetchInfo*> childInfos;
+    std::vector<Value*> children;
+    for (auto& info : offsets) {
+        if (budget == 0) {
+          break;
+        }
+        if (info.countField >= 0) {
+          emitBoundedArrayPrefetch(builder, node, eltT, info, budget, insertBefore, F);
+          continue;
+        }
+        --budget;
+        // Compute address of struct element using byte offset
+        std::vector<Value*> offsetValues = {zero};
+        for (auto offset : info.gepOffsets){
+          offsetValues.push_back(ConstantInt::get(Type::getInt32Ty(context), offset));
+        }
+        auto indexes =  ArrayRef<Value*>(offsetValues);
+        //errs() << " offsets: " << indexes << " \n";
+        Value* elementAddr = builder.CreateInBoundsGEP(eltT, castToStruct(builder, node, eltT), indexes, "");
+        Value* loadPtr = loadChild(builder, info, elementAddr);
+
+        emitPrefetchLines(builder, loadPtr, info.pointeeType, F);
+        children.push_back(loadPtr);
+        childInfos.push_back(&info);
+    }
+
+    if (levelsLeft <= 1) {
+      return;
+    }
+
+    //issue every prefetch for this level before descending so the misses overlap
+    for (size_t c = 0; c < children.size(); ++c) {
+      Value* child = children[c];
+      StructType* childType = childInfos[c]->pointeeType;
+      std::vector<PrefetchInfo> childOffsets = getUsedPrefetchInfoForStruct(childType);
+      if (onlyMembers && childType == eltT) {
+        childOffsets.erase(std::remove_if(childOffsets.begin(), childOffsets.end(),
+                                          [&](PrefetchInfo& info) { return !onlyMembers->count(info.gepOffsets); }),
+                           childOffsets.end());
+      }
+      if (childOffsets.empty() || budget == 0) {
+        continue;
+      }
+      Value* nullValue = ConstantPointerNull::get(childInfos[c]->structPointerType);
+      Value* isNonNull = builder.CreateICmpNE(child, nullValue, "isNonNull");
+      BasicBlock* childBlock = BasicBlock::Create(context, "prefetch-child", &F, insertBefore);
+      BasicBlock* continueBlock = BasicBlock::Create(context, "prefetch-continue", &F, insertBefore);
+      builder.CreateCondBr(isNonNull, childBlock, continueBlock);
+      builder.SetInsertPoint(childBlock);
+      emitPrefetchesForNode(builder, child, childType, childOffsets, levelsLeft - 1, budget, continueBlock, F,
+                            onlyMembers);
+      builder.CreateBr(continueBlock);
+      builder.SetInsertPoint(continueBlock);
+    }
+  }
+
+  /***
+  * Generates prefetch instructions for given RDS (greedily prefetch entire RDS)
+  */
+  void genAndInsertPrefetchInstructions(Value* arg, StructType* argType, std::vector<PrefetchInfo>& offsets,
+                                        PrefetchPlan& plan, Function& F) {
+    /***
+     * Steps:
+     * 1. Load the argument (this is the address of arg now)
+     * For each offset:
+     *   - Compute address of struct element
+     *   - Prefetch addres
+     *   - If there is lookahead left, null check the loaded child and repeat
+     * Total instructions 1 + 2 * (num_offsets) at depth 1
+    */
+    LLVMContext& context = F.getContext();
+    Value* nullValue = ConstantPointerNull::get(cast<PointerType>(arg->getType()));
+
+    // Create the comparison instruction
+    // Split after the static allocas, moving them out of the entry block would
+    // turn them into dynamic allocas
+    BasicBlock* entry = &F.getEntryBlock();
+    BasicBlock::iterator splitPoint = entry->getFirstInsertionPt();
+    while (isa<AllocaInst>(*splitPoint)) {
+      ++splitPoint;
+    }
+    BasicBlock* originalFirstBlock = SplitBlock(entry, &*splitPoint);
+    entry->getTerminator()->eraseFromParent();
+    IRBuilder<> builder(context);
+    builder.SetInsertPoint(entry);
+    Value* isNonNull = builder.CreateICmpNE(arg, nullValue, "isNonNull");
+    BasicBlock *conditionalBlock = BasicBlock::Create(context, "conditional", &F, originalFirstBlock);
+    builder.CreateCondBr(isNonNull, conditionalBlock, originalFirstBlock);
+    builder.SetInsertPoint(conditionalBlock);
+
+    unsigned budget = MaxPrefetchesPerArgument;
+    if (!plan.descent.empty()) {
+      //only one candidate is taken, so keep the speculation to a few lines
+      std::vector<PrefetchInfo> candidates;
+      for (auto& info : offsets) {
+        if (plan.descent.count(info.gepOffsets)) {
+          candidates.push_back(info);
+        }
+      }
+      size_t linesPerNode = getPrefetchLines(argType, F.getParent()->getDataLayout()).size();
+      budget = std::max<size_t>(1, SearchMaxLines / std::max<size_t>(1, linesPerNode));
+      emitPrefetchesForNode(builder, arg, argType, candidates, std::max(1u, (unsigned)SearchDepth), budget,
+                            originalFirstBlock, F, &plan.descent);
+    } else if (plan.firstVisited.empty()) {
+      emitPrefetchesForNode(builder, arg, argType, offsets, plan.depth, budget, originalFirstBlock, F);
+    } else {
+      //the child recursed into first is dereferenced right away, a prefetch of it
+      //can't arrive in time, so look past it; later children have the first
+      //subtree's traversal to arrive in. Those go first so they overlap the miss
+      //on the first child.
+      std::vector<PrefetchInfo> first, later;
+      for (auto& info : offsets) {
+        (info.countField < 0 && info.gepOffsets == plan.firstVisited ? first : later).push_back(info);
+      }
+      emitPrefetchesForNode(builder, arg, argType, later, plan.depth, budget, originalFirstBlock, F);
+      for (auto& info : first) {
+        std::vector<PrefetchInfo> grandchildren = getUsedPrefetchInfoForStruct(info.pointeeType);
+        if (grandchildren.empty() || budget == 0) {
+          continue;
+        }
+        std::vector<Value*> indexes = {builder.getInt32(0)};
+        for (auto offset : info.gepOffsets) {
+          indexes.push_back(builder.getInt32(offset));
+        }
+        Value* child = loadChild(builder, info, builder.CreateInBoundsGEP(argType, castToStruct(builder, arg, argType), indexes));
+        BasicBlock* childBlock = BasicBlock::Create(context, "prefetch-first-child", &F, originalFirstBlock);
+        BasicBlock* continueBlock = BasicBlock::Create(context, "prefetch-continue", &F, originalFirstBlock);
+        builder.CreateCondBr(builder.CreateICmpNE(child, ConstantPointerNull::get(info.structPointerType)),
+                             childBlock, continueBlock);
+        builder.SetInsertPoint(childBlock);
+        emitPrefetchesForNode(builder, child, info.pointeeType, grandchildren, plan.depth, budget, continueBlock, F);
+        builder.CreateBr(continueBlock);
+        builder.SetInsertPoint(continueBlock);
+      }
+    }
+
+    if (plan.jumpPointers && isRecursiveStruct(argType)) {
+      emitJumpPointerPrefetch(builder, arg, argType, plan.jumpDistance, originalFirstBlock, F);
+    }
+
+    builder.CreateBr(originalFirstBlock);
+    originalFirstBlock->moveAfter(builder.GetInsertBlock());
+  }
+  
+  //a loop header phi that walks a list through one of its own fields
+  struct PointerChase {
+    PHINode* node;        //the induction variable, p
+    PrefetchInfo next;    //where p->next lives in *p, pointeeType is the type of *p
+  };
+
+  /***
+   * Finds loop header phis of struct pointer type whose value on the backedge is
+   * loaded out of the phi itself, i.e. p = p->next. Needs SSA form (run mem2reg
+   * first at -O0), the alloca traffic of unoptimized code hides the recurrence.
+  */
+  std::vector<PointerChase> getPointerChasingLoops(LoopInfo& LI) {
+    std::vector<PointerChase> res;
+    for (Loop* L : LI.getLoopsInPreorder()) {
+      BasicBlock* latch = L->getLoopLatch();
+      if (!latch) {
+        continue;
+      }
+      for (PHINode& phi : L->getHeader()->phis()) {
+        auto* phiType = dyn_cast<PointerType>(phi.getType());
+        if (!phiType) {
+          continue;
+        }
+        Value* incoming = phi.getIncomingValueForBlock(latch)->stripPointerCasts();
+        LoadInst* index = getDecodedLink(incoming);
+        auto* load = index ? index : dyn_cast<LoadInst>(incoming);
+        if (!load || (!index && load->getType() != phiType)) {
+          continue;
+        }
+        auto* gep = dyn_cast<GetElementPtrInst>(load->getPointerOperand()->stripPointerCasts());
+        if (!gep || gep->getPointerOperand()->stripPointerCasts() != &phi ||
+            !isa<StructType>(gep->getSourceElementType()) ||
+            !gep->hasAllConstantIndices() || gep->getNumIndices() < 2 ||
+            !cast<ConstantInt>(gep->getOperand(1))->isZero()) {
+          continue;
+        }
+        std::vector<size_t> offsets;
+        for (unsigned i = 2; i < gep->getNumOperands(); ++i) {
+          offsets.push_back(cast<ConstantInt>(gep->getOperand(i))->getZExtValue());
+        }
+        auto* nodeType = cast<StructType>(gep->getSourceElementType());
+        GlobalVariable* pool = nullptr;
+        if (index) {
+          auto compressed = compressedLinks.find({nodeType, offsets[0]});
+          if (compressed == compressedLinks.end()) {
+            continue;
+          }
+          pool = compressed->second;
+        }
+        res.push_back({&phi, {offsets, phiType, nodeType, -1, pool}});
+      }
+    }
+    return res;
+  }
+
+  /***
+   * Walks distance nodes down the list from the top of the loop body, prefetching
+   * each one, then prefetches the record pointers held by the node before the
+   * farthest. That node was prefetched an iteration ago, reading the farthest
+   * one would stall on the miss just issued for it. At distance 1 the node
+   * before the farthest is the current one, whose records the body is about to
+   * read anyway, so there is no payload prefetch.
+  */
+  void genAndInsertLoopPrefetchInstructions(PointerChase& chase, Function& F) {
+    LLVMContext& context = F.getContext();
+    BasicBlock* header = chase.node->getParent();
+    BasicBlock* body = SplitBlock(header, &*header->getFirstInsertionPt());
+    header->getTerminator()->eraseFromParent();
+    IRBuilder<> builder(header);
+
+    StructType* nodeType = chase.next.pointeeType;
+    Value* nullValue = ConstantPointerNull::get(chase.next.structPointerType);
+    Value* zero = ConstantInt::get(Type::getInt32Ty(context), 0);
+    std::vector<Value*> offsetValues = {zero};
+    for (auto offset : chase.next.gepOffsets) {
+      offsetValues.push_back(ConstantInt::get(Type::getInt32Ty(context), offset));
+    }
+
+    Value* current = chase.node;
+    Value* previous = nullptr;
+    unsigned distance = std::max(1u, (unsigned)LoopPrefetchDistance);
+    for (unsigned i = 0; i < distance; ++i) {
+      BasicBlock* nextBlock = BasicBlock::Create(context, "chase-next", &F, body);
+      builder.CreateCondBr(builder.CreateICmpNE(current, nullValue, "isNonNull"), nextBlock, body);
+      builder.SetInsertPoint(nextBlock);
+      Value* elementAddr = builder.CreateInBoundsGEP(nodeType, castToStruct(builder, current, nodeType), offsetValues, "");
+      previous = current;
+      current = loadChild(builder, chase.next, elementAddr);
+      emitPrefetchLines(builder, current, nodeType, F);
+    }
+
+    //payload pointers of the node before the farthest (non null, its link was just read), skipping the link
+    std::vector<PrefetchInfo> payload;
+    for (auto& info : getUsedPrefetchInfoForStruct(nodeType)) {
+      if (previous != chase.node && info.gepOffsets != chase.next.gepOffsets) {
+        payload.push_back(info);
+      }
+    }
+    if (!payload.empty()) {
+      unsigned budget = MaxPrefetchesPerArgument;
+      emitPrefetchesForNode(builder, previous, nodeType, payload, 1, budget, body, F);
+    }
+    builder.CreateBr(body);
+  }
+
+  //a recursive call on one slot of a bounded child array, inside the loop walking it
+  struct SiblingSite {
+    CallInst* call;
+    Value* node;          //the node holding the array
+    StructType* nodeType;
+    Value* array;         //the loaded heap array, null for a fixed size member
+    Value* index;         //the slot passed to call
+    PrefetchInfo info;    //the bounded array member
+  };
+
+  /***
+   * Finds recursive calls that are passed children[i] of a bounded child array,
+   * i.e. f(n->children[i]) or f(n->to_nodes[i]). Must run before any CFG changes.
+  */
+  std::vector<SiblingSite> getSiblingPrefetchSites(Function& F, std::vector<Function*>& scc) {
+    std::vector<SiblingSite> res;
+    if (SiblingPrefetchDistance == 0) {
+      return res;
+    }
+    for (CallInst* call : getRecursiveCalls(F, scc)) {
+      for (auto& operand : call->args()) {
+        auto* child = dyn_cast<LoadInst>(operand->stripPointerCasts());
+        auto* slot = child ? dyn_cast<GetElementPtrInst>(child->getPointerOperand()->stripPointerCasts()) : nullptr;
+        if (!slot) {
+          continue;
+        }
+        SiblingSite site = {call, nullptr, nullptr, nullptr, nullptr, {}};
+        GetElementPtrInst* member = slot;
+        if (isa<StructType>(slot->getSourceElementType()) && slot->getNumIndices() >= 3 &&
+            !isa<ConstantInt>(slot->getOperand(3))) {
+          site.index = slot->getOperand(3);
+        } else if (slot->getSourceElementType()->isPointerTy() && slot->getNumIndices() == 1) {
+          auto* array = dyn_cast<LoadInst>(slot->getPointerOperand()->stripPointerCasts());
+          member = array ? dyn_cast<GetElementPtrInst>(array->getPointerOperand()->stripPointerCasts()) : nullptr;
+          if (!member || !isa<StructType>(member->getSourceElementType()) || member->getNumIndices() != 2) {
+            continue;
+          }
+          site.array = slot->getPointerOperand();
+          site.index = slot->getOperand(1);
+        } else {
+          continue;
+        }
+        site.node = member->getPointerOperand();
+        site.nodeType = cast<StructType>(member->getSourceElementType());
+        size_t field = cast<ConstantInt>(member->getOperand(2))->getZExtValue();
+        for (auto& info : getPrefetchInfoForStruct(site.nodeType)) {
+          if (info.countField >= 0 && info.gepOffsets[0] == field) {
+            site.info = info;
+            res.push_back(site);
+            pipelinedArrays.insert({site.nodeType, field});
+            break;
+          }
+        }
+      }
+    }
+    return res;
+  }
+
+  /***
+   * Software pipelines the child array walk: right before recursing into slot i,
+   * prefetch the sibling k slots ahead and its pointer members, so each iteration
+   * issues the prefetches for one later subtree instead of the whole array being
+   * requested at function entry. The first iteration also covers slots 1 to k - 1.
+  */
+  void genAndInsertSiblingPrefetchInstructions(SiblingSite& site, Function& F) {
+    BasicBlock* callBlock = site.call->getParent();
+    BasicBlock* rest = SplitBlock(callBlock, site.call);
+    callBlock->getTerminator()->eraseFromParent();
+    IRBuilder<> builder(callBlock);
+    Type* i64 = builder.getInt64Ty();
+    Value* distance = ConstantInt::get(i64, SiblingPrefetchDistance);
+    Value* one = ConstantInt::get(i64, 1);
+
+    Value* index = builder.CreateSExtOrTrunc(site.index, i64);
+    Value* first = builder.CreateICmpEQ(index, ConstantInt::get(i64, 0));
+    Value* ahead = builder.CreateAdd(index, distance);
+    Value* begin = builder.CreateSelect(first, one, ahead, "sibling.begin");
+    Value* end = builder.CreateAdd(ahead, one);
+    Value* count = emitChildCount(builder, site.node, site.nodeType, site.info);
+    end = builder.CreateSelect(builder.CreateICmpULT(end, count), end, count, "sibling.end");
+
+    //the subtree root and its own links, but not another array walk per sibling
+    std::vector<PrefetchInfo> siblingFields;
+    for (auto& info : getUsedPrefetchInfoForStruct(site.info.pointeeType)) {
+      if (info.countField < 0) {
+        siblingFields.push_back(info);
+      }
+    }
+    emitArraySlotPrefetchLoop(builder, site.node, site.nodeType, site.info, site.array, begin, end,
+                              builder.CreateICmpULT(begin, end), &siblingFields, rest, F);
+    builder.CreateBr(rest);
+  }
+
+  //an allocation of an RDS node that is repeated by a loop or recursion
+  struct AllocationSite {
+    CallInst* call;
+    StructType* nodeType;
+    uint64_t size;        //bytes requested (count x size for calloc), at least the node's
+  };
+
+  /***
+   * Finds malloc like calls whose result is used as a struct with record pointer
+   * members, inside a loop or in a recursive function, i.e. tree and list builders
+  */
+  std::vector<AllocationSite> getAllocationSites(Function& F, std::vector<Function*>& scc, LoopInfo& LI,
+                                                 const TargetLibraryInfo& TLI) {
+    std::vector<AllocationSite> res;
+    if (!AllocationPrefetch) {
+      return res;
+    }
+    bool recursive = !getRecursiveCalls(F, scc).empty();
+    for (auto& bb : F) {
+      if (!recursive && !LI.getLoopFor(&bb)) {
+        continue;
+      }
+      for (auto& instr : bb) {
+        auto* call = dyn_cast<CallInst>(&instr);
+        if (!call || (!isMallocOrCallocLikeFn(call, &TLI) && !isPoolAllocation(call))) {
+          continue;
+        }
+        StructType* nodeType = getPointeeStructType(call);
+        if (nodeType && !nodeType->isOpaque() && !getPrefetchInfoForStruct(nodeType).empty()) {
+          uint64_t size = F.getParent()->getDataLayout().getTypeAllocSize(nodeType);
+          res.push_back({call, nodeType, std::max(size, getAllocationSize(call, TLI).value_or(0))});
+        }
+      }
+    }
+    return res;
+  }
+
+  /***
+   * The storage of an allocation doesn't exist before the allocator returns it,
+   * but allocators tend to hand out consecutive nodes at a steady stride. Right
+   * after each allocation, predict the next one from the stride between the last
+   * two and prefetch its lines for writing, so the construction that follows the
+   * next allocation doesn't miss. A wrong guess only costs a useless prefetch.
+  */
+  void genAndInsertAllocationPrefetchInstructions(AllocationSite& site, Function& F) {
+    LLVMContext& context = F.getContext();
+    Module& M = *F.getParent();
+    Type* i8 = Type::getInt8Ty(context);
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    Type* i64 = Type::getInt64Ty(context);
+    uint64_t size = site.size;
+
+    //one per site and thread, interleaved allocations of other sites or threads don't disturb its stride
+    auto* last = new GlobalVariable(M, i8Ptr, false, GlobalValue::InternalLinkage,
+                                    ConstantPointerNull::get(cast<PointerType>(i8Ptr)),
+                                    "__greedy_prefetch_alloc_last");
+    last->setThreadLocal(true);
+    IRBuilder<> builder(site.call->getNextNode());
+    Value* current = builder.CreateBitCast(site.call, i8Ptr);
+    Value* previous = builder.CreateLoad(i8Ptr, last, "alloc.previous");
+    builder.CreateStore(current, last);
+    Value* stride = builder.CreateSub(builder.CreatePtrToInt(current, i64), builder.CreatePtrToInt(previous, i64));
+    stride = builder.CreateSelect(builder.CreateICmpEQ(previous, ConstantPointerNull::get(cast<PointerType>(i8Ptr))),
+                                  ConstantInt::get(i64, size), stride, "alloc.stride");
+    //a gep without inbounds, the prediction may point anywhere
+    Value* next = builder.CreateGEP(i8, current, stride, "alloc.next");
+    uint64_t lines = std::min<uint64_t>((size + cacheLineSize - 1) / cacheLineSize,
+                                        std::max(1u, (unsigned)MaxLinesPerObject));
+    for (uint64_t line = 0; line < lines; ++line) {
+      Value* address = line == 0 ? next : builder.CreateGEP(i8, next, builder.getInt64(line * cacheLineSize));
+      emitPrefetch(builder, address, F, true, 3);
+    }
+  }
+
+  /***
+   * Returns true if v is arg, or a reload of the stack slot that unoptimized code
+   * spills arg into
+  */
+  bool isArgumentOrSpill(Value* v, Argument* arg) {
+    v = v->stripPointerCasts();
+    if (v == arg) {
+      return true;
+    }
+    auto* load = dyn_cast<LoadInst>(v);
+    auto* slot = load ? dyn_cast<AllocaInst>(load->getPointerOperand()) : nullptr;
+    if (!slot) {
+      return false;
+    }
+    for (auto* user : slot->users()) {
+      if (auto* store = dyn_cast<StoreInst>(user)) {
+        if (store->getPointerOperand() == slot && store->getValueOperand() != arg) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  /***
+   * Returns the member path of *arg whose value the call passes on, e.g. {1} for
+   * f(arg->l) when l is member 1. The path stops at the first non constant
+   * index, so f(arg->children[i]) with children as member 2 gives {2}.
+  */
+  std::optional<std::vector<size_t>> getFieldPassedToCall(CallInst* call, Argument* arg) {
+    for (auto& operand : call->args()) {
+      auto* load = dyn_cast<LoadInst>(operand->stripPointerCasts());
+      auto* gep = load ? dyn_cast<GetElementPtrInst>(load->getPointerOperand()->stripPointerCasts()) : nullptr;
+      if (!gep || gep->getNumIndices() < 2 || !isArgumentOrSpill(gep->getPointerOperand(), arg)) {
+        continue;
+      }
+      std::vector<size_t> path;
+      for (unsigned i = 2; i < gep->getNumOperands(); ++i) {
+        auto* index = dyn_cast<ConstantInt>(gep->getOperand(i));
+        if (!index) {
+          break;
+        }
+        path.push_back(index->getZExtValue());
+      }
+      return path;
+    }
+    return std::nullopt;
+  }
+
+  /***
+   * Adds to members the members of *arg that v may be loaded from, looking through
+   * selects, phis and the stack temporaries unoptimized code keeps them in. Returns
+   * false if v can be anything else.
+  */
+  bool collectDescentCandidates(Value* v, Argument* arg, std::set<std::vector<size_t>>& members,
+                                SmallPtrSet<Value*, 8>& visited) {
+    v = v->stripPointerCasts();
+    if (!visited.insert(v).second || isa<ConstantPointerNull>(v)) {
+      return true;
+    }
+    if (auto* select = dyn_cast<SelectInst>(v)) {
+      return collectDescentCandidates(select->getTrueValue(), arg, members, visited) &&
+             collectDescentCandidates(select->getFalseValue(), arg, members, visited);
+    }
+    if (auto* phi = dyn_cast<PHINode>(v)) {
+      for (Value* incoming : phi->incoming_values()) {
+        if (!collectDescentCandidates(incoming, arg, members, visited)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    auto* load = dyn_cast<LoadInst>(v);
+    if (!load) {
+      return false;
+    }
+    Value* address = load->getPointerOperand()->stripPointerCasts();
+    if (auto* gep = dyn_cast<GetElementPtrInst>(address)) {
+      if (!gep->hasAllConstantIndices() || gep->getNumIndices() < 2 || !isArgumentOrSpill(gep->getPointerOperand(), arg)) {
+        return false;
+      }
+      std::vector<size_t> path;
+      for (unsigned i = 2; i < gep->getNumOperands(); ++i) {
+        path.push_back(cast<ConstantInt>(gep->getOperand(i))->getZExtValue());
+      }
+      members.insert(path);
+      return true;
+    }
+    auto* slot = dyn_cast<AllocaInst>(address);
+    if (!slot) {
+      return false;
+    }
+    for (auto* user : slot->users()) {
+      if (auto* store = dyn_cast<StoreInst>(user)) {
+        if (store->getPointerOperand() != slot ||
+            !collectDescentCandidates(store->getValueOperand(), arg, members, visited)) {
+          return false;
+        }
+      } else if (!isa<LoadInst>(user)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /***
+   * Returns the members a search descent picks from, when a recursive call is passed
+   * one of several members of *arg chosen at run time, as in
+   * f(key < t->key ? t->l : t->r), or when recursive calls on different members sit
+   * on paths that exclude one another, as in
+   * if (key < t->key) return f(t->l); else return f(t->r);
+   * The candidates must point to the same struct as arg so the choice repeats at
+   * every level.
+  */
+  std::set<std::vector<size_t>> getSearchDescentMembers(Argument* arg, StructType* argType,
+                                                        std::vector<CallInst*>& calls) {
+    std::set<std::vector<size_t>> descent;
+    std::vector<std::pair<CallInst*, std::vector<size_t>>> single;
+    for (auto* call : calls) {
+      for (auto& operand : call->args()) {
+        std::set<std::vector<size_t>> members;
+        SmallPtrSet<Value*, 8> visited;
+        if (!collectDescentCandidates(operand, arg, members, visited) || members.empty()) {
+          continue;
+        }
+        if (members.size() == 1) {
+          single.push_back({call, *members.begin()});
+          continue;
+        }
+        descent.insert(members.begin(), members.end());
+      }
+    }
+    //neither call can run after the other, so each visit takes one of the branches
+    for (size_t i = 0; i < single.size(); ++i) {
+      for (size_t j = i + 1; j < single.size(); ++j) {
+        auto& [first, firstMember] = single[i];
+        auto& [second, secondMember] = single[j];
+        if (firstMember != secondMember && !isPotentiallyReachable(first, second) &&
+            !isPotentiallyReachable(second, first)) {
+          descent.insert(firstMember);
+          descent.insert(secondMember);
+        }
+      }
+    }
+    std::set<std::vector<size_t>> recursive;
+    for (auto& info : getPrefetchInfoForStruct(argType)) {
+      if (info.pointeeType == argType && descent.count(info.gepOffsets)) {
+        recursive.insert(info.gepOffsets);
+      }
+    }
+    return recursive.size() < 2 ? std::set<std::vector<size_t>>() : recursive;
+  }
+
+  /***
+   * Returns the member of *arg passed to the recursive call that runs first, when
+   * the calls recurse into at least two different members, as in
+   * f(t->l); f(t->r). Calls are ordered by a reverse post order of the CFG.
+  */
+  std::optional<std::vector<size_t>> getFirstVisitedChild(Function& F, Argument* arg, std::vector<CallInst*>& calls) {
+    std::map<BasicBlock*, unsigned> order;
+    ReversePostOrderTraversal<Function*> rpo(&F);
+    for (BasicBlock* bb : rpo) {
+      order[bb] = order.size();
+    }
+    CallInst* first = nullptr;
+    std::set<std::vector<size_t>> fields;
+    for (auto* call : calls) {
+      auto field = getFieldPassedToCall(call, arg);
+      if (!field) {
+        continue;
+      }
+      fields.insert(*field);
+      if (!first || order[call->getParent()] < order[first->getParent()] ||
+          (call->getParent() == first->getParent() && call->comesBefore(first))) {
+        first = call;
+      }
+    }
+    if (fields.size() < 2) {
+      return std::nullopt;
+    }
+    return getFieldPassedToCall(first, arg);
+  }
+
+  /***
+   * Drops prefetches of members that are only ever passed to recursive calls the
+   * profile says rarely run. Members that reach no recursive call are kept.
+  */
+  void removeColdChildren(Argument* arg, std::vector<CallInst*>& calls, std::vector<PrefetchInfo>& offsets,
+                          BlockFrequencyInfo& BFI) {
+    uint64_t entryFreq = BFI.getEntryFreq();
+    if (entryFreq == 0) {
+      return;
+    }
+    std::map<std::vector<size_t>, bool> fieldIsHot;
+    for (auto* call : calls) {
+      auto field = getFieldPassedToCall(call, arg);
+      if (!field) {
+        continue;
+      }
+      double ratio = (double)BFI.getBlockFreq(call->getParent()).getFrequency() / entryFreq;
+      fieldIsHot[*field] = fieldIsHot[*field] || ratio >= HotCallRatio;
+    }
+    auto isCold = [&](PrefetchInfo& info) {
+      for (auto& [field, hot] : fieldIsHot) {
+        if (!hot && std::equal(field.begin(), field.end(), info.gepOffsets.begin(),
+                               info.gepOffsets.begin() + std::min(field.size(), info.gepOffsets.size()))) {
+          return true;
+        }
+      }
+      return false;
+    };
+    offsets.erase(std::remove_if(offsets.begin(), offsets.end(), isCold), offsets.end());
+  }
+
+  /***
+   * Drops pointer chases of loops the profile says rarely run, using the same
+   * per entry ratio as recursive call sites
+  */
+  void removeColdChases(std::vector<PointerChase>& chases, BlockFrequencyInfo& BFI) {
+    uint64_t entryFreq = BFI.getEntryFreq();
+    if (entryFreq == 0) {
+      return;
+    }
+    auto isCold = [&](PointerChase& chase) {
+      return (double)BFI.getBlockFreq(chase.node->getParent()).getFrequency() / entryFreq < HotCallRatio;
+    };
+    chases.erase(std::remove_if(chases.begin(), chases.end(), isCold), chases.end());
+  }
+
+  //the object a pointer is based on, seeing through the stack slot unoptimized code spills it to
+  const Value* getFlagObject(Value* ptr) {
+    const Value* base = getUnderlyingObject(ptr);
+    if (auto* load = dyn_cast<LoadInst>(base)) {
+      if (auto* slot = dyn_cast<AllocaInst>(load->getPointerOperand())) {
+        return slot;
+      }
+    }
+    return base;
+  }
+
+  /***
+   * Returns true if fn branches on a value loaded from an object it also stores
+   * to, the visited check of a graph walk (tests/test1.c)
+  */
+  bool hasVisitedCheck(Function& fn) {
+    std::set<const Value*> stored;
+    for (auto& ins : instructions(fn)) {
+      if (auto* store = dyn_cast<StoreInst>(&ins)) {
+        if (!isa<AllocaInst>(store->getPointerOperand())) {
+          stored.insert(getFlagObject(store->getPointerOperand()));
+        }
+      }
+    }
+    for (auto& bb : fn) {
+      auto* branch = dyn_cast<BranchInst>(bb.getTerminator());
+      if (!branch || !branch->isConditional()) {
+        continue;
+      }
+      Value* condition = branch->getCondition();
+      if (auto* cmp = dyn_cast<CmpInst>(condition)) {
+        condition = cmp->getOperand(0);
+      }
+      while (auto* cast = dyn_cast<CastInst>(condition)) {
+        condition = cast->getOperand(0);
+      }
+      auto* load = dyn_cast<LoadInst>(condition);
+      if (load && stored.count(getFlagObject(load->getPointerOperand()))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /***
+   * Returns true if there is evidence that the traversal starting at F visits each
+   * node once: every call from outside the recursive call chain is known and sits
+   * outside loops, and the chain has no visited check (a graph walk that meets
+   * nodes again). Child loops inside the chain don't count, an n-ary tree walk
+   * still visits each child once. Without such evidence the nodes may be reused.
+  */
+  bool isSinglePassTraversal(Function& F, std::vector<Function*>& chain, FunctionAnalysisManager& FAM) {
+    //callers in other modules may call it from anywhere
+    if (!F.hasLocalLinkage() && LTOPhaseOpt != LTOPhase::PostLink) {
+      return false;
+    }
+    bool called = false;
+    for (auto* user : F.users()) {
+      auto* call = dyn_cast<CallInst>(user);
+      if (!call || call->getCalledFunction() != &F) {
+        return false;
+      }
+      Function* caller = call->getFunction();
+      if (std::find(chain.begin(), chain.end(), caller) != chain.end()) {
+        continue;
+      }
+      if (FAM.getResult<LoopAnalysis>(*caller).getLoopFor(call->getParent())) {
+        return false;
+      }
+      called = true;
+    }
+    if (!called) {
+      return false;
+    }
+    for (auto* fn : chain) {
+      if (fn->isDeclaration() || hasVisitedCheck(*fn)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /***
+   * Returns map from call to vector of Arguments that it relies on
+  */
+  std::unordered_map<Value*, std::vector<CallInst*>> getArgumentsToCallsThatNeedIt(Function &F,
+                                                                                 const std::vector<Function*>& scc) {
+    std::unordered_map<Value*, std::vector<CallInst*>> output;
+    auto arglist = F.args();
+    std::vector<CallInst*> recursiveCalls = getRecursiveCalls(F, scc);
+
+    //the function isn't recursive so its not a candidate for this optimization.
+    if (recursiveCalls.empty()){
+      return output;
+    }
+
+    for (auto arg = arglist.begin(); arg != arglist.end(); ++arg){
+      std::set<CallInst*> derived = getCallsDerivedFromArgument(arg);
+      for (auto* recursiveCall : recursiveCalls){
+        if (derived.count(recursiveCall)) {
+          output[arg].push_back(recursiveCall);
+        }
+      }
+    }
+    return output;
+  }
+  
+
+  /***
+   * Whole program summaries for LTO. In the pre-link compile every module records,
+   * per defined function, the functions it calls and the struct members it uses,
+   * as named metadata. Full LTO merges named metadata along with the modules. For
+   * ThinLTO, whose backends only see their own module, the summary is also written
+   * to -greedy-prefetch-summary-dir. Post-link, summaries of functions that are not
+   * defined in the module being optimized feed the SCC and field usage analyses.
+   * Functions are keyed by their global identifier, which for locals includes the
+   * source file, so same named statics of different modules stay apart.
+   *
+   * !greedy.prefetch.summary = !{!{!"fn", !{!"callee", ...}, !{!"struct.T", field, element, flags, !"struct.P"}, ...}, ...}
+   * element is -1 unless a constant array element is used, struct.P is the struct
+   * the member points to when the defining module could recover it, else ""
+  */
+  static constexpr const char* SummaryName = "greedy.prefetch.summary";
+  enum SummaryFlags { SummaryUsed = 1, SummaryStored = 2, SummaryDynamicArray = 4 };
+
+  struct FunctionSummary {
+    std::vector<std::string> callees;
+    std::map<std::string, FieldUsage> usage; //by struct type name
+  };
+  std::map<std::string, FunctionSummary> summaries; //by getSummaryKey
+  std::map<std::pair<std::string, size_t>, std::string> summaryPointeeTypes;
+
+  /***
+   * Returns the key summaries use for fn, its global identifier under the name it
+   * had before ThinLTO promoted it: "foo" for an external function, "a.c:foo" for
+   * a static one. A promoted local only declared here doesn't know the file it
+   * came from, it takes the key of the one summarised local with its name, if any.
+  */
+  std::string getSummaryKey(const Function& fn) {
+    StringRef name = ModuleSummaryIndex::getOriginalNameBeforePromote(fn.getName());
+    if (!fn.hasLocalLinkage() && name == fn.getName()) {
+      return fn.getName().str();
+    }
+    if (fn.isDeclaration()) {
+      std::string found;
+      for (auto& [key, summary] : summaries) {
+        auto [file, local] = StringRef(key).rsplit(':');
+        if (!file.empty() && local == name) {
+          if (!found.empty()) {
+            return fn.getName().str();
+          }
+          found = key;
+        }
+      }
+      return found.empty() ? fn.getName().str() : found;
+    }
+    return GlobalValue::getGlobalIdentifier(name, GlobalValue::InternalLinkage, fn.getParent()->getSourceFileName());
+  }
+
+  MDNode* buildFunctionSummary(Function& F) {
+    LLVMContext& context = F.getContext();
+    Type* i64 = Type::getInt64Ty(context);
+    std::vector<Metadata*> callees;
+    std::set<Function*> seen;
+    for (auto& bb : F) {
+      for (auto& instr : bb) {
+        auto* call = dyn_cast<CallInst>(&instr);
+        Function* callee = call ? call->getCalledFunction() : nullptr;
+        if (callee && !callee->isIntrinsic() && callee->hasName() && seen.insert(callee).second) {
+          callees.push_back(MDString::get(context, getSummaryKey(*callee)));
+        }
+      }
+    }
+    std::vector<Metadata*> operands = {MDString::get(context, getSummaryKey(F)), MDNode::get(context, callees)};
+    std::vector<Function*> self = {&F};
+    computeFieldUsage(self);
+    auto entry = [&](StructType* structType, size_t field, int64_t element, uint64_t flags) {
+      StructType* pointee = getFieldPointeeType(structType, field);
+      operands.push_back(MDNode::get(context, {MDString::get(context, structType->getName()),
+                                               ConstantAsMetadata::get(ConstantInt::get(i64, field)),
+                                               ConstantAsMetadata::get(ConstantInt::get(i64, element, true)),
+                                               ConstantAsMetadata::get(ConstantInt::get(i64, flags)),
+                                               MDString::get(context, pointee && pointee->hasName()
+                                                                          ? pointee->getName() : "")}));
+    };
+    for (auto& [structType, usage] : fieldUsage) {
+      if (!structType->hasName()) {
+        continue;
+      }
+      for (size_t field : usage.fields) {
+        uint64_t flags = SummaryUsed;
+        flags |= usage.storedFields.count(field) ? SummaryStored : 0;
+        flags |= usage.dynamicArrays.count(field) ? SummaryDynamicArray : 0;
+        entry(structType, field, -1, flags);
+      }
+      for (auto& [field, element] : usage.arrayElements) {
+        entry(structType, field, element, SummaryUsed);
+      }
+    }
+    fieldUsage.clear();
+    return MDNode::get(context, operands);
+  }
+
+  /***
+   * Attaches this module's summary and, if a summary directory is set, writes it
+   * there as a bitcode file holding only the summary
+  */
+  void exportSummary(Module& M) {
+    NamedMDNode* named = M.getOrInsertNamedMetadata(SummaryName);
+    named->clearOperands();
+    for (auto& F : M) {
+      if (!F.isDeclaration()) {
+        named->addOperand(buildFunctionSummary(F));
+      }
+    }
+    if (SummaryDir.empty()) {
+      return;
+    }
+    Module summaryModule(M.getModuleIdentifier(), M.getContext());
+    NamedMDNode* copy = summaryModule.getOrInsertNamedMetadata(SummaryName);
+    for (MDNode* node : named->operands()) {
+      copy->addOperand(node);
+    }
+    SmallString<128> path(SummaryDir);
+    sys::path::append(path, std::to_string(hash_value(M.getModuleIdentifier())) + ".summary.bc");
+    std::error_code error;
+    raw_fd_ostream out(path, error, sys::fs::OF_None);
+    if (error) {
+      errs() << "greedy-prefetch: can't write summary " << path << ": " << error.message() << "\n";
+      return;
+    }
+    WriteBitcodeToFile(summaryModule, out);
+  }
+
+  /***
+   * Reads the summaries of named that aren't defined in M. A function that already
+   * has a summary keeps it, so the first source read wins over older ones.
+  */
+  void readSummaries(NamedMDNode* named, const std::set<std::string>& defined) {
+    std::set<std::string> read;
+    for (MDNode* node : named->operands()) {
+      auto* name = dyn_cast<MDString>(node->getOperand(0));
+      auto* callees = dyn_cast<MDNode>(node->getOperand(1));
+      if (!name || !callees) {
+        continue;
+      }
+      //the module's own definitions are analysed directly
+      std::string key = name->getString().str();
+      if (defined.count(key) || (summaries.count(key) && !read.count(key))) {
+        continue;
+      }
+      read.insert(key);
+      FunctionSummary& summary = summaries[key];
+      for (auto& callee : callees->operands()) {
+        if (auto* calleeName = dyn_cast<MDString>(callee)) {
+          summary.callees.push_back(calleeName->getString().str());
+        }
+      }
+      for (unsigned i = 2; i < node->getNumOperands(); ++i) {
+        auto* entry = dyn_cast<MDNode>(node->getOperand(i));
+        if (!entry || entry->getNumOperands() != 5) {
+          continue;
+        }
+        auto* structName = dyn_cast<MDString>(entry->getOperand(0));
+        auto* field = mdconst::dyn_extract<ConstantInt>(entry->getOperand(1));
+        auto* element = mdconst::dyn_extract<ConstantInt>(entry->getOperand(2));
+        auto* flags = mdconst::dyn_extract<ConstantInt>(entry->getOperand(3));
+        auto* pointeeName = dyn_cast<MDString>(entry->getOperand(4));
+        if (!structName || !field || !element || !flags || !pointeeName) {
+          continue;
+        }
+        if (!pointeeName->getString().empty()) {
+          summaryPointeeTypes[{structName->getString().str(), field->getZExtValue()}] = pointeeName->getString().str();
+        }
+        FieldUsage& usage = summary.usage[structName->getString().str()];
+        usage.fields.insert(field->getZExtValue());
+        if (element->getSExtValue() >= 0) {
+          usage.arrayElements.insert({field->getZExtValue(), (size_t)element->getSExtValue()});
+        }
+        if (flags->getZExtValue() & SummaryStored) {
+          usage.storedFields.insert(field->getZExtValue());
+        }
+        if (flags->getZExtValue() & SummaryDynamicArray) {
+          usage.dynamicArrays.insert(field->getZExtValue());
+        }
+      }
+    }
+  }
+
+  /***
+   * Collects the summaries of functions defined outside this module: from the
+   * merged named metadata (full LTO) and from the summary directory (ThinLTO).
+   * The directory may hold stale files of modules that were renamed or moved
+   * since, so newer files are read first and a function's newest summary wins
+   * instead of being merged with the stale one.
+  */
+  void importSummaries(Module& M) {
+    summaries.clear();
+    summaryPointeeTypes.clear();
+    std::set<std::string> defined;
+    for (auto& F : M) {
+      if (!F.isDeclaration()) {
+        defined.insert(getSummaryKey(F));
+      }
+    }
+    if (NamedMDNode* named = M.getNamedMetadata(SummaryName)) {
+      readSummaries(named, defined);
+    }
+    if (SummaryDir.empty()) {
+      return;
+    }
+    std::vector<std::pair<sys::TimePoint<>, std::string>> files;
+    std::error_code error;
+    for (sys::fs::directory_iterator file(SummaryDir, error), end; file != end && !error; file.increment(error)) {
+      auto status = file->status();
+      if (StringRef(file->path()).endswith(".summary.bc") && status) {
+        files.push_back({status->getLastModificationTime(), file->path()});
+      }
+    }
+    std::sort(files.begin(), files.end(), std::greater<>());
+    for (auto& [time, path] : files) {
+      SMDiagnostic diagnostic;
+      std::unique_ptr<Module> summaryModule = parseIRFile(path, diagnostic, M.getContext());
+      if (!summaryModule) {
+        continue;
+      }
+      if (NamedMDNode* named = summaryModule->getNamedMetadata(SummaryName)) {
+        readSummaries(named, defined);
+      }
+    }
+  }
+
+  //struct.T.12 -> struct.T, anything else unchanged
+  StringRef stripNumericSuffix(StringRef name) {
+    auto [base, suffix] = name.rsplit('.');
+    if (!suffix.empty() && suffix.find_first_not_of("0123456789") == StringRef::npos) {
+      return base;
+    }
+    return name;
+  }
+
+  /***
+   * Returns the struct type of this module that a summary names. Linking can give
+   * identical types a numeric suffix, struct.T.12, so that is ignored too.
+  */
+  StructType* getSummaryStructType(StringRef name, LLVMContext& context) {
+    if (auto* structType = StructType::getTypeByName(context, name)) {
+      return structType;
+    }
+    StringRef base = stripNumericSuffix(name);
+    return base != name ? StructType::getTypeByName(context, base) : nullptr;
+  }
+
+  /***
+   * Adds the field usage other modules recorded for the functions of scc they define
+  */
+  void mergeSummaryFieldUsage(std::vector<Function*>& scc) {
+    for (Function* fn : scc) {
+      auto summary = summaries.find(getSummaryKey(*fn));
+      if (!fn->isDeclaration() || summary == summaries.end()) {
+        continue;
+      }
+      for (auto& [structName, usage] : summary->second.usage) {
+        StructType* structType = getSummaryStructType(structName, fn->getContext());
+        if (!structType) {
+          continue;
+        }
+        FieldUsage& merged = fieldUsage[structType];
+        merged.fields.insert(usage.fields.begin(), usage.fields.end());
+        merged.arrayElements.insert(usage.arrayElements.begin(), usage.arrayElements.end());
+        merged.dynamicArrays.insert(usage.dynamicArrays.begin(), usage.dynamicArrays.end());
+        merged.storedFields.insert(usage.storedFields.begin(), usage.storedFields.end());
+      }
+    }
+  }
+
+  /***
+   * Like getRecursiveSCCs, but over the call graph extended with the calls made by
+   * summarised functions defined in other modules, so recursion that crosses
+   * translation units is found. SCCs may then contain declarations.
+  */
+  std::vector<std::vector<Function*>> getRecursiveSCCsWithSummaries(Module& M, CallGraph& CG) {
+    std::map<std::string, std::set<std::string>> edges;
+    std::map<std::string, Function*> byKey;
+    for (auto& F : M) {
+      byKey[getSummaryKey(F)] = &F;
+      if (F.isDeclaration()) {
+        continue;
+      }
+      for (auto& record : *CG[&F]) {
+        Function* callee = record.second->getFunction();
+        if (callee && callee->hasName()) {
+          edges[getSummaryKey(F)].insert(getSummaryKey(*callee));
+        }
+      }
+    }
+    for (auto& [name, summary] : summaries) {
+      edges[name].insert(summary.callees.begin(), summary.callees.end());
+    }
+
+    //Tarjan's algorithm
+    std::map<std::string, unsigned> index, lowlink;
+    std::set<std::string> onStack;
+    std::vector<std::string> stack;
+    std::vector<std::vector<Function*>> res;
+    unsigned next = 0;
+    std::function<void(const std::string&)> visit = [&](const std::string& name) {
+      index[name] = lowlink[name] = next++;
+      stack.push_back(name);
+      onStack.insert(name);
+      for (auto& callee : edges[name]) {
+        if (!index.count(callee)) {
+          visit(callee);
+          lowlink[name] = std::min(lowlink[name], lowlink[callee]);
+        } else if (onStack.count(callee)) {
+          lowlink[name] = std::min(lowlink[name], index[callee]);
+        }
+      }
+      if (lowlink[name] != index[name]) {
+        return;
+      }
+      std::vector<std::string> members;
+      do {
+        members.push_back(stack.back());
+        onStack.erase(stack.back());
+        stack.pop_back();
+      } while (members.back() != name);
+      if (members.size() == 1 && !edges[name].count(name)) {
+        return;
+      }
+      std::vector<Function*> functions;
+      bool hasDefinition = false;
+      for (auto& member : members) {
+        auto fn = byKey.find(member);
+        if (fn != byKey.end()) {
+          functions.push_back(fn->second);
+          hasDefinition = hasDefinition || !fn->second->isDeclaration();
+        }
+      }
+      if (hasDefinition) {
+        res.push_back(std::move(functions));
+      }
+    };
+    std::vector<std::string> names;
+    for (auto& [name, callees] : edges) {
+      names.push_back(name);
+    }
+    for (auto& name : names) {
+      if (!index.count(name)) {
+        visit(name);
+      }
+    }
+    return res;
+  }
+
+  /***
+   * Pool allocation. malloc(sizeof(T)) and calloc(1, sizeof(T)) of recursive
+   * struct types are routed to a pool per type in the runtime library, which
+   * bump allocates them so that nodes built one after the other are adjacent in
+   * memory whatever else the program allocates in between. Unlike Lattner's
+   * automatic pool allocation there is one pool per type rather than per data
+   * structure instance, which needs no points-to analysis. Pool nodes can't be
+   * handed to the C library, so every free and realloc of the module goes through
+   * the runtime, which passes other pointers on.
+  */
+  static constexpr const char* PoolAllocName = "__greedy_pool_alloc";
+  static constexpr const char* PoolCallocName = "__greedy_pool_calloc";
+
+  bool isPoolAllocation(CallInst* call) {
+    Function* callee = call->getCalledFunction();
+    return callee && (callee->getName() == PoolAllocName || callee->getName() == PoolCallocName);
+  }
+
+  //GreedyPool in runtime/greedyPrefetchRuntime.h
+  StructType* getPoolType(LLVMContext& context) {
+    if (auto* existing = StructType::getTypeByName(context, "struct.GreedyPool")) {
+      return existing;
+    }
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    return StructType::create(context, {i8Ptr, i8Ptr, i8Ptr, Type::getInt64Ty(context), i8Ptr}, "struct.GreedyPool");
+  }
+
+  GlobalVariable* getOrCreatePool(Module& M, StructType* nodeType) {
+    std::string name = "__greedy_pool." + (nodeType->hasName() ? nodeType->getName().str() : "anon");
+    if (auto* existing = M.getGlobalVariable(name, true)) {
+      return existing;
+    }
+    LLVMContext& context = M.getContext();
+    StructType* poolType = getPoolType(context);
+    //rounded up to the 16 byte malloc alignment
+    uint64_t size = alignTo(M.getDataLayout().getTypeAllocSize(nodeType), 16);
+    auto* i8Ptr = cast<PointerType>(Type::getInt8PtrTy(context));
+    Constant* init = ConstantStruct::get(poolType, {ConstantPointerNull::get(i8Ptr), ConstantPointerNull::get(i8Ptr),
+                                                    ConstantPointerNull::get(i8Ptr),
+                                                    ConstantInt::get(Type::getInt64Ty(context), size),
+                                                    ConstantPointerNull::get(i8Ptr)});
+    return new GlobalVariable(M, poolType, false, GlobalValue::InternalLinkage, init, name);
+  }
+
+  bool poolAllocate(Module& M, FunctionAnalysisManager& FAM) {
+    LLVMContext& context = M.getContext();
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    Type* i64 = Type::getInt64Ty(context);
+    const DataLayout& DL = M.getDataLayout();
+
+    std::vector<std::pair<CallInst*, StructType*>> sites;
+    for (auto& F : M) {
+      if (F.isDeclaration()) {
+        continue;
+      }
+      const TargetLibraryInfo& TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+      for (auto& bb : F) {
+        for (auto& instr : bb) {
+          auto* call = dyn_cast<CallInst>(&instr);
+          Function* callee = call ? call->getCalledFunction() : nullptr;
+          LibFunc func;
+          if (!callee || !TLI.getLibFunc(*callee, func)) {
+            continue;
+          }
+          if (func != LibFunc_malloc && func != LibFunc_calloc) {
+            continue;
+          }
+          StructType* nodeType = getPointeeStructType(call);
+          if (!nodeType || nodeType->isOpaque() || !isRecursiveStruct(nodeType)) {
+            continue;
+          }
+          //a single node, arrays of nodes stay on the heap
+          uint64_t nodeSize = DL.getTypeAllocSize(nodeType);
+          auto* size = dyn_cast<ConstantInt>(call->getArgOperand(func == LibFunc_calloc ? 1 : 0));
+          auto* count = func == LibFunc_calloc ? dyn_cast<ConstantInt>(call->getArgOperand(0)) : nullptr;
+          if (size && size->getZExtValue() <= alignTo(nodeSize, 16) && (func == LibFunc_malloc || (count && count->isOne()))) {
+            sites.push_back({call, nodeType});
+          }
+        }
+      }
+    }
+    if (!canRedirectReleases(M) || sites.empty()) {
+      return false;
+    }
+
+    Type* poolPtr = getPoolType(context)->getPointerTo();
+    for (auto& [call, nodeType] : sites) {
+      IRBuilder<> builder(call);
+      GlobalVariable* pool = getOrCreatePool(M, nodeType);
+      std::vector<Value*> args = {pool};
+      for (auto& arg : call->args()) {
+        args.push_back(builder.CreateZExtOrTrunc(arg, i64));
+      }
+      FunctionCallee allocator = args.size() == 2
+                                     ? M.getOrInsertFunction(PoolAllocName, i8Ptr, poolPtr, i64)
+                                     : M.getOrInsertFunction(PoolCallocName, i8Ptr, poolPtr, i64, i64);
+      CallInst* replacement = builder.CreateCall(allocator, args);
+      replacement->takeName(call);
+      call->replaceAllUsesWith(builder.CreateBitCast(replacement, call->getType()));
+      call->eraseFromParent();
+    }
+    redirectReleases(M);
+    return true;
+  }
+
+  //free passed around as a function pointer could get a pool node
+  bool canRedirectReleases(Module& M) {
+    for (const char* name : {"free", "realloc"}) {
+      Function* release = M.getFunction(name);
+      if (!release) {
+        continue;
+      }
+      for (auto* user : release->users()) {
+        auto* call = dyn_cast<CallInst>(user);
+        if (!call || call->getCalledOperand() != release) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  void redirectReleases(Module& M) {
+    for (const char* name : {"free", "realloc"}) {
+      Function* release = M.getFunction(name);
+      if (!release) {
+        continue;
+      }
+      StringRef replacement = release->getName() == "realloc" ? "__greedy_pool_realloc" : "__greedy_pool_free";
+      for (auto* user : make_early_inc_range(release->users())) {
+        auto* call = cast<CallInst>(user);
+        call->setCalledFunction(M.getOrInsertFunction(replacement, call->getFunctionType()));
+      }
+    }
+  }
+
+  /***
+   * Relayout. A tree built by a recursive constructor, e.g. Node* build(int depth),
+   * is copied by the runtime into cache line sized subtree clusters right after
+   * the constructor returns (runtime/relayout.c). Moving nodes is only safe when
+   * the returned root is the only way to reach them, so the constructor's SCC
+   * takes no nodes as arguments and its nodes are only linked into each other,
+   * kept in locals, compared and returned.
+  */
+  static constexpr const char* RelayoutName = "__greedy_relayout";
+
+  struct Constructor {
+    std::vector<Function*> scc;
+    StructType* nodeType;
+  };
+
+  //byte offsets of the members holding children, an array of them counts element by element
+  std::vector<uint64_t> getLinkOffsets(StructType* structType, const DataLayout& DL) {
+    std::vector<uint64_t> offsets;
+    const StructLayout* layout = DL.getStructLayout(structType);
+    for (size_t i = 0; i < structType->getNumElements(); ++i) {
+      if (getFieldPointeeType(structType, i) != structType) {
+        continue;
+      }
+      Type* element = structType->getElementType(i);
+      if (element->isPointerTy()) {
+        offsets.push_back(layout->getElementOffset(i));
+      } else if (auto* array = dyn_cast<ArrayType>(element)) {
+        uint64_t stride = DL.getTypeAllocSize(array->getElementType());
+        for (uint64_t j = 0; j < array->getNumElements(); ++j) {
+          offsets.push_back(layout->getElementOffset(i) + j * stride);
+        }
+      }
+    }
+    return offsets;
+  }
+
+  //the constant size of a malloc, calloc or pool allocation
+  std::optional<uint64_t> getAllocationSize(CallInst* call, const TargetLibraryInfo& TLI) {
+    Function* callee = call->getCalledFunction();
+    LibFunc func;
+    unsigned first = 0;
+    bool counted = false;
+    if (isPoolAllocation(call)) {
+      first = 1;
+      counted = callee->getName() == PoolCallocName;
+    } else if (callee && TLI.getLibFunc(*callee, func) && (func == LibFunc_malloc || func == LibFunc_calloc)) {
+      counted = func == LibFunc_calloc;
+    } else {
+      return std::nullopt;
+    }
+    uint64_t size = 1;
+    for (unsigned i = first; i <= first + counted; ++i) {
+      auto* operand = dyn_cast<ConstantInt>(call->getArgOperand(i));
+      if (!operand) {
+        return std::nullopt;
+      }
+      size *= operand->getZExtValue();
+    }
+    return size;
+  }
+
+  /***
+   * Returns the recursive struct the SCC builds if its nodes can't be reached
+   * other than through the returned root. Node values are followed through casts,
+   * phis, selects, locals and loads of links, every use has to be one the
+   * relayout can't break.
+  */
+  StructType* getConstructedType(std::vector<Function*>& scc, FunctionAnalysisManager& FAM) {
+    std::set<Function*> members(scc.begin(), scc.end());
+    StructType* nodeType = nullptr;
+    SmallVector<Value*, 32> worklist;
+    for (Function* fn : scc) {
+      if (fn->isDeclaration() || !fn->getReturnType()->isPointerTy()) {
+        return nullptr;
+      }
+      const TargetLibraryInfo& TLI = FAM.getResult<TargetLibraryAnalysis>(*fn);
+      for (auto& instr : instructions(*fn)) {
+        auto* call = dyn_cast<CallInst>(&instr);
+        if (!call) {
+          continue;
+        }
+        if (members.count(call->getCalledFunction())) {
+          worklist.push_back(call);
+          continue;
+        }
+        auto size = getAllocationSize(call, TLI);
+        StructType* allocated = size ? getPointeeStructType(call) : nullptr;
+        if (!allocated || allocated->isOpaque() || !isRecursiveStruct(allocated)) {
+          continue;
+        }
+        //the runtime copies exactly one node
+        const DataLayout& DL = fn->getParent()->getDataLayout();
+        if ((nodeType && nodeType != allocated) || *size != DL.getTypeAllocSize(allocated)) {
+          return nullptr;
+        }
+        nodeType = allocated;
+        worklist.push_back(call);
+      }
+    }
+    if (!nodeType) {
+      return nullptr;
+    }
+    for (Function* fn : scc) {
+      for (auto& arg : fn->args()) {
+        if (getArgumentStructType(&arg) == nodeType) {
+          return nullptr;
+        }
+      }
+    }
+
+    const DataLayout& DL = scc.front()->getParent()->getDataLayout();
+    std::vector<uint64_t> links = getLinkOffsets(nodeType, DL);
+    auto isLink = [&](uint64_t offset) { return std::find(links.begin(), links.end(), offset) != links.end(); };
+    SmallPtrSet<Value*, 32> nodes;
+    //stores whose value has to be a node or null, checked once every node is known
+    std::vector<StoreInst*> linkStores;
+    //stores of nodes that aren't into locals, each has to be one of linkStores
+    std::vector<StoreInst*> linked;
+
+    //a load or store of the member at offset, or a cast of its address
+    std::function<bool(Instruction*, Value*, uint64_t)> isFieldAccess = [&](Instruction* user, Value* address,
+                                                                              uint64_t offset) {
+      if (auto* load = dyn_cast<LoadInst>(user)) {
+        if (isLink(offset)) {
+          if (!load->getType()->isPointerTy()) {
+            return false;
+          }
+          worklist.push_back(load);
+        }
+        return true;
+      }
+      if (auto* store = dyn_cast<StoreInst>(user)) {
+        if (store->getPointerOperand() != address) {
+          return false;
+        }
+        if (isLink(offset)) {
+          linkStores.push_back(store);
+        }
+        return true;
+      }
+      if (isa<BitCastInst>(user)) {
+        for (auto* castUser : user->users()) {
+          if (!isFieldAccess(cast<Instruction>(castUser), user, offset)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      return false;
+    };
+
+    while (!worklist.empty()) {
+      Value* node = worklist.pop_back_val();
+      if (!nodes.insert(node).second) {
+        continue;
+      }
+      for (auto* user : node->users()) {
+        auto* instr = dyn_cast<Instruction>(user);
+        if (!instr) {
+          return nullptr;
+        }
+        if (isa<BitCastInst>(instr) || isa<PHINode>(instr) || isa<SelectInst>(instr)) {
+          worklist.push_back(instr);
+        } else if (isa<ICmpInst>(instr) || isa<ReturnInst>(instr) || isa<DbgInfoIntrinsic>(instr)) {
+          continue;
+        } else if (auto* memset = dyn_cast<MemSetInst>(instr)) {
+          if (memset->getDest() != node) {
+            return nullptr;
+          }
+        } else if (auto* gep = dyn_cast<GetElementPtrInst>(instr)) {
+          APInt offset(DL.getIndexTypeSizeInBits(gep->getType()), 0);
+          if (gep->getPointerOperand() != node || !gep->accumulateConstantOffset(DL, offset)) {
+            return nullptr;
+          }
+          for (auto* access : gep->users()) {
+            if (!isFieldAccess(cast<Instruction>(access), gep, offset.getZExtValue())) {
+              return nullptr;
+            }
+          }
+        } else if (auto* store = dyn_cast<StoreInst>(instr)) {
+          if (store->getPointerOperand() == node) {
+            if (isLink(0)) {
+              linkStores.push_back(store);
+            }
+            continue;
+          }
+          //spilled to a local, the reloads are nodes too
+          auto* local = dyn_cast<AllocaInst>(store->getPointerOperand());
+          if (local) {
+            for (auto* localUser : local->users()) {
+              if (auto* reload = dyn_cast<LoadInst>(localUser)) {
+                worklist.push_back(reload);
+              } else if (auto* spill = dyn_cast<StoreInst>(localUser)) {
+                if (spill->getPointerOperand() != local) {
+                  return nullptr;
+                }
+                linkStores.push_back(spill);
+              } else if (!isa<DbgInfoIntrinsic>(localUser) && !cast<Instruction>(localUser)->isLifetimeStartOrEnd()) {
+                return nullptr;
+              }
+            }
+            continue;
+          }
+          //has to be linked into another node, otherwise it escapes
+          linked.push_back(store);
+        } else if (auto* load = dyn_cast<LoadInst>(instr)) {
+          if (!isFieldAccess(load, node, 0)) {
+            return nullptr;
+          }
+        } else {
+          return nullptr;
+        }
+      }
+    }
+
+    //a node from anywhere else mixed in would be moved under its owner's feet
+    auto isNodeOrNull = [&](Value* v) { return nodes.count(v) || isa<ConstantPointerNull>(v) || isa<UndefValue>(v); };
+    for (StoreInst* store : linkStores) {
+      if (!isNodeOrNull(store->getValueOperand())) {
+        return nullptr;
+      }
+    }
+    for (StoreInst* store : linked) {
+      if (std::find(linkStores.begin(), linkStores.end(), store) == linkStores.end()) {
+        return nullptr;
+      }
+    }
+    for (Value* node : nodes) {
+      if (auto* phi = dyn_cast<PHINode>(node)) {
+        if (!all_of(phi->incoming_values(), isNodeOrNull)) {
+          return nullptr;
+        }
+      } else if (auto* select = dyn_cast<SelectInst>(node)) {
+        if (!isNodeOrNull(select->getTrueValue()) || !isNodeOrNull(select->getFalseValue())) {
+          return nullptr;
+        }
+      }
+    }
+    for (Function* fn : scc) {
+      for (auto& instr : instructions(*fn)) {
+        auto* ret = dyn_cast<ReturnInst>(&instr);
+        if (ret && !isNodeOrNull(ret->getReturnValue())) {
+          return nullptr;
+        }
+      }
+    }
+    return nodeType;
+  }
+
+  //GreedyLayout in runtime/greedyPrefetchRuntime.h
+  GlobalVariable* getOrCreateLayout(Module& M, StructType* nodeType, unsigned clusterSize) {
+    std::string name = "__greedy_layout." + (nodeType->hasName() ? nodeType->getName().str() : "anon") + "." +
+                       std::to_string(clusterSize);
+    if (auto* existing = M.getGlobalVariable(name, true)) {
+      return existing;
+    }
+    const DataLayout& DL = M.getDataLayout();
+    Type* i64 = Type::getInt64Ty(M.getContext());
+    std::vector<Constant*> offsets;
+    for (uint64_t offset : getLinkOffsets(nodeType, DL)) {
+      offsets.push_back(ConstantInt::get(i64, offset));
+    }
+    Constant* linkOffsets = ConstantArray::get(ArrayType::get(i64, offsets.size()), offsets);
+    Constant* init = ConstantStruct::getAnon({ConstantInt::get(i64, DL.getTypeAllocSize(nodeType)),
+                                              ConstantInt::get(i64, clusterSize),
+                                              ConstantInt::get(i64, offsets.size()), linkOffsets});
+    return new GlobalVariable(M, init->getType(), true, GlobalValue::InternalLinkage, init, name);
+  }
+
+  bool relayoutConstructedTrees(Module& M, FunctionAnalysisManager& FAM, std::vector<std::vector<Function*>>& sccs) {
+    if (!canRedirectReleases(M)) {
+      return false;
+    }
+    std::vector<Constructor> constructors;
+    for (auto& scc : sccs) {
+      if (StructType* nodeType = getConstructedType(scc, FAM)) {
+        constructors.push_back({scc, nodeType});
+      }
+    }
+
+    LLVMContext& context = M.getContext();
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    bool changed = false;
+    for (auto& constructor : constructors) {
+      std::set<Function*> members(constructor.scc.begin(), constructor.scc.end());
+      //the outermost calls, a call from inside the SCC returns a subtree still being built
+      std::vector<CallInst*> calls;
+      for (Function* fn : constructor.scc) {
+        for (auto* user : fn->users()) {
+          auto* call = dyn_cast<CallInst>(user);
+          if (call && call->getCalledFunction() == fn && !members.count(call->getFunction())) {
+            calls.push_back(call);
+          }
+        }
+      }
+      for (CallInst* call : calls) {
+        Function& caller = *call->getFunction();
+        unsigned clusterSize = CacheLineSize;
+        if (clusterSize == 0) {
+          clusterSize = FAM.getResult<TargetIRAnalysis>(caller).getCacheLineSize();
+        }
+        if (clusterSize == 0) {
+          clusterSize = 64;
+        }
+        IRBuilder<> builder(call->getNextNode());
+        Value* root = builder.CreateBitCast(call, i8Ptr);
+        Value* layout = builder.CreateBitCast(getOrCreateLayout(M, constructor.nodeType, clusterSize), i8Ptr);
+        FunctionCallee relayout =
+            M.getOrInsertFunction(RelayoutName, i8Ptr, i8Ptr, i8Ptr, getPoolType(context)->getPointerTo());
+        CallInst* moved = builder.CreateCall(relayout, {root, layout, getOrCreatePool(M, constructor.nodeType)});
+        Value* newRoot = builder.CreateBitCast(moved, call->getType());
+        call->replaceUsesWithIf(newRoot, [&](Use& use) { return use.getUser() != root && use.getUser() != moved; });
+        FAM.invalidate(caller, PreservedAnalyses::none());
+        changed = true;
+      }
+    }
+    if (changed) {
+      redirectReleases(M);
+    }
+    return changed;
+  }
+
+  /***
+   * Hot/cold splitting. The members of an RDS type that the traversals never
+   * read are moved to a cold struct reached through one pointer at the end of the
+   * hot part, so a node's hot members take fewer cache lines and more nodes share
+   * a line. Every GEP on the type is rewritten, which is only sound if the nodes
+   * are never touched other than through those GEPs: the pass follows every value
+   * that may hold a node through the whole module and gives up on the type if one
+   * reaches code it can't see or can't rewrite.
+  */
+  struct SplitLayout {
+    StructType* hot;
+    StructType* cold;
+    std::vector<std::pair<bool, unsigned>> fields; //original member -> (is hot, index in its part)
+  };
+
+  //the nodes' memory as the legality check found it
+  struct NodeSites {
+    std::vector<GetElementPtrInst*> geps;
+    std::vector<CallInst*> allocations;
+    std::vector<CallInst*> releases;
+    bool directAccess = false; //the first member is accessed through the node pointer itself
+  };
+
+  //recursive structs and the structs their members point to
+  std::vector<StructType*> getLayoutCandidates(Module& M) {
+    std::set<StructType*> candidates;
+    for (StructType* structType : M.getIdentifiedStructTypes()) {
+      if (structType->isOpaque() || !isRecursiveStruct(structType)) {
+        continue;
+      }
+      candidates.insert(structType);
+      for (auto& info : getPrefetchInfoForStruct(structType)) {
+        if (info.pointeeType && !info.pointeeType->isOpaque()) {
+          candidates.insert(info.pointeeType);
+        }
+      }
+    }
+    return std::vector<StructType*>(candidates.begin(), candidates.end());
+  }
+
+  static bool containsType(Type* outer, StructType* inner) {
+    if (outer == inner) {
+      return true;
+    }
+    if (auto* array = dyn_cast<ArrayType>(outer)) {
+      return containsType(array->getElementType(), inner);
+    }
+    if (auto* vector = dyn_cast<VectorType>(outer)) {
+      return containsType(vector->getElementType(), inner);
+    }
+    if (auto* structType = dyn_cast<StructType>(outer)) {
+      return any_of(structType->elements(), [&](Type* element) { return containsType(element, inner); });
+    }
+    return false;
+  }
+
+  //a pointer to inner, at any level of indirection, among the parameters or result of fn
+  static bool hasTypeInSignature(Function& fn, StructType* inner) {
+    auto pointsTo = [&](Type* type) {
+      while (auto* pointer = dyn_cast<PointerType>(type)) {
+        if (pointer->isOpaque()) {
+          return false;
+        }
+        type = pointer->getPointerElementType();
+      }
+      return containsType(type, inner);
+    };
+    return pointsTo(fn.getReturnType()) || any_of(fn.getFunctionType()->params(), pointsTo);
+  }
+
+  //whether the address of a member is read from, passed on or kept rather than only stored to
+  static bool isFieldRead(Value* address) {
+    for (auto* user : address->users()) {
+      auto* store = dyn_cast<StoreInst>(user);
+      if (store && store->getPointerOperand() == address) {
+        continue;
+      }
+      if ((isa<GetElementPtrInst>(user) || isa<BitCastInst>(user)) && !isFieldRead(user)) {
+        continue;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /***
+   * Returns the members worth keeping in the hot part: the links, and the members
+   * read by a recursive traversal or in a loop. With a profile, members whose reads
+   * run less than SplitColdRatio as often as the hottest member's are cold.
+  */
+  std::set<unsigned> getHotFields(StructType* structType, Module& M, FunctionAnalysisManager& FAM,
+                                  std::unordered_map<Function*, std::vector<Function*>>& sccOf) {
+    std::set<unsigned> hot;
+    std::map<unsigned, uint64_t> profileCounts;
+    for (unsigned i = 0; i < structType->getNumElements(); ++i) {
+      if (getFieldPointeeType(structType, i) == structType) {
+        hot.insert(i);
+      }
+    }
+    for (auto& F : M) {
+      if (F.isDeclaration()) {
+        continue;
+      }
+      bool profiled = ProfileGuided && F.getEntryCount();
+      for (auto& instr : instructions(F)) {
+        auto* gep = dyn_cast<GetElementPtrInst>(&instr);
+        if (!gep || gep->getSourceElementType() != structType || gep->getNumIndices() < 2 || !isFieldRead(gep)) {
+          continue;
+        }
+        unsigned field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+        if (profiled) {
+          auto count = FAM.getResult<BlockFrequencyAnalysis>(F).getBlockProfileCount(gep->getParent());
+          profileCounts[field] += count ? *count : 0;
+        } else if (sccOf.count(&F) || FAM.getResult<LoopAnalysis>(F).getLoopFor(gep->getParent())) {
+          hot.insert(field);
+        }
+      }
+    }
+    uint64_t hottest = 0;
+    for (auto& [field, count] : profileCounts) {
+      hottest = std::max(hottest, count);
+    }
+    for (auto& [field, count] : profileCounts) {
+      if (count > 0 && count >= SplitColdRatio * hottest) {
+        hot.insert(field);
+      }
+    }
+    return hot;
+  }
+
+  //memory holding pointers, keyed coarsely enough that two accesses to the same memory share a key
+  using SlotKey = std::pair<const void*, size_t>;
+
+  SlotKey getSlotKey(Value* address) {
+    Value* base = address->stripPointerCasts();
+    while (auto* gep = dyn_cast<GEPOperator>(base)) {
+      if (isa<StructType>(gep->getSourceElementType()) && gep->getNumIndices() >= 2) {
+        return {gep->getSourceElementType(), cast<ConstantInt>(gep->getOperand(2))->getZExtValue()};
+      }
+      base = gep->getPointerOperand()->stripPointerCasts();
+    }
+    if (isa<AllocaInst>(base) || isa<GlobalVariable>(base)) {
+      return {base, 0};
+    }
+    //anywhere else
+    return {nullptr, 0};
+  }
+
+  /***
+   * Follows every value that may point to a node of the given type, forwards through
+   * its uses and backwards to where it came from, across calls and through memory.
+  */
+  bool getNodeSites(StructType* structType, Module& M, FunctionAnalysisManager& FAM, NodeSites& sites) {
+    const DataLayout& DL = M.getDataLayout();
+    for (StructType* other : M.getIdentifiedStructTypes()) {
+      if (other != structType && containsType(other, structType)) {
+        return false;
+      }
+    }
+    for (auto& global : M.globals()) {
+      if (containsType(global.getValueType(), structType)) {
+        return false;
+      }
+    }
+    //code in other modules would hand over or keep nodes in the old layout
+    for (auto& F : M) {
+      bool visible = F.isDeclaration() || (!F.hasLocalLinkage() && LTOPhaseOpt != LTOPhase::PostLink);
+      if (visible && hasTypeInSignature(F, structType)) {
+        return false;
+      }
+    }
+
+    std::map<SlotKey, std::vector<Instruction*>> slotAccesses;
+    SmallPtrSet<Value*, 32> nodes;
+    SmallVector<Value*, 64> worklist;
+    auto addNode = [&](Value* v) {
+      if (isa<ConstantPointerNull>(v) || isa<UndefValue>(v)) {
+        return true;
+      }
+      if (isa<Constant>(v)) {
+        return false;
+      }
+      worklist.push_back(v);
+      return true;
+    };
+    for (auto& F : M) {
+      for (auto& arg : F.args()) {
+        if (arg.hasByValAttr() && containsType(arg.getParamByValType(), structType)) {
+          return false;
+        }
+      }
+      for (auto& instr : instructions(F)) {
+        for (auto& operand : instr.operands()) {
+          auto* constant = dyn_cast<GEPOperator>(operand.get());
+          if (constant && !isa<Instruction>(constant) && constant->getSourceElementType() == structType) {
+            return false;
+          }
+        }
+        if (auto* alloca = dyn_cast<AllocaInst>(&instr)) {
+          if (containsType(alloca->getAllocatedType(), structType)) {
+            return false;
+          }
+        } else if (auto* gep = dyn_cast<GetElementPtrInst>(&instr)) {
+          if (gep->getSourceElementType() == structType) {
+            worklist.push_back(gep->getPointerOperand());
+          }
+        } else if (auto* load = dyn_cast<LoadInst>(&instr)) {
+          if (containsType(load->getType(), structType)) {
+            return false;
+          }
+          if (load->getType()->isPointerTy()) {
+            slotAccesses[getSlotKey(load->getPointerOperand())].push_back(load);
+          }
+        } else if (auto* store = dyn_cast<StoreInst>(&instr)) {
+          if (containsType(store->getValueOperand()->getType(), structType)) {
+            return false;
+          }
+          if (store->getValueOperand()->getType()->isPointerTy()) {
+            slotAccesses[getSlotKey(store->getPointerOperand())].push_back(store);
+          }
+        } else if (auto* call = dyn_cast<CallInst>(&instr)) {
+          const TargetLibraryInfo& TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+          if (getAllocationSize(call, TLI) && getPointeeStructType(call) == structType) {
+            worklist.push_back(call);
+          }
+        }
+      }
+    }
+
+    std::set<SlotKey> slots;
+    SmallPtrSet<GetElementPtrInst*, 32> geps;
+    SmallPtrSet<CallInst*, 16> allocations, releases;
+    uint64_t firstFieldSize = DL.getTypeStoreSize(structType->getElementType(0));
+    auto isFirstFieldAccess = [&](Type* accessed) {
+      sites.directAccess = true;
+      return DL.getTypeStoreSize(accessed) <= firstFieldSize;
+    };
+    //the values in a slot are nodes, and so is everything stored to it
+    auto addSlot = [&](Value* address) {
+      SlotKey key = getSlotKey(address);
+      if (!slots.insert(key).second) {
+        return true;
+      }
+      for (auto* access : slotAccesses[key]) {
+        auto* store = dyn_cast<StoreInst>(access);
+        if (!addNode(store ? store->getValueOperand() : access)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    //every call of a function has to be visible to follow its arguments and result
+    auto getCalls = [&](Function* F, std::vector<CallInst*>& calls) {
+      if (!F->hasLocalLinkage() && LTOPhaseOpt != LTOPhase::PostLink) {
+        return false;
+      }
+      for (auto* user : F->users()) {
+        auto* call = dyn_cast<CallInst>(user);
+        if (!call || call->getCalledOperand() != F) {
+          return false;
+        }
+        calls.push_back(call);
+      }
+      return true;
+    };
+
+    while (!worklist.empty()) {
+      Value* node = worklist.pop_back_val();
+      if (!nodes.insert(node).second) {
+        continue;
+      }
+      std::vector<CallInst*> calls;
+
+      //where it comes from
+      if (auto* arg = dyn_cast<Argument>(node)) {
+        if (!getCalls(arg->getParent(), calls)) {
+          return false;
+        }
+        for (CallInst* call : calls) {
+          if (!addNode(call->getArgOperand(arg->getArgNo()))) {
+            return false;
+          }
+        }
+      } else if (auto* call = dyn_cast<CallInst>(node)) {
+        Function* callee = call->getCalledFunction();
+        const TargetLibraryInfo& TLI = FAM.getResult<TargetLibraryAnalysis>(*call->getFunction());
+        if (auto size = getAllocationSize(call, TLI)) {
+          //a single node, whose size the rewrite can change
+          if (isPoolAllocation(call) || getPointeeStructType(call) != structType ||
+              *size != DL.getTypeAllocSize(structType) ||
+              (call->arg_size() == 2 && !cast<ConstantInt>(call->getArgOperand(0))->isOne())) {
+            return false;
+          }
+          allocations.insert(call);
+        } else if (!callee || callee->isDeclaration()) {
+          return false;
+        } else {
+          for (auto& instr : instructions(*callee)) {
+            auto* ret = dyn_cast<ReturnInst>(&instr);
+            if (ret && !addNode(ret->getReturnValue())) {
+              return false;
+            }
+          }
+        }
+      } else if (auto* load = dyn_cast<LoadInst>(node)) {
+        if (!addSlot(load->getPointerOperand())) {
+          return false;
+        }
+      } else if (isa<PHINode>(node) || isa<SelectInst>(node) || isa<BitCastInst>(node) ||
+                 isa<AddrSpaceCastInst>(node)) {
+        auto* instr = cast<Instruction>(node);
+        for (unsigned i = isa<SelectInst>(instr) ? 1 : 0; i < instr->getNumOperands(); ++i) {
+          if (!addNode(instr->getOperand(i))) {
+            return false;
+          }
+        }
+      } else {
+        return false;
+      }
+
+      //where it goes
+      for (auto& use : node->uses()) {
+        auto* user = dyn_cast<Instruction>(use.getUser());
+        if (!user) {
+          return false;
+        }
+        if (isa<BitCastInst>(user) || isa<AddrSpaceCastInst>(user) || isa<PHINode>(user) ||
+            (isa<SelectInst>(user) && use.getOperandNo() > 0)) {
+          worklist.push_back(user);
+        } else if (isa<ICmpInst>(user) || isa<DbgInfoIntrinsic>(user) || user->isLifetimeStartOrEnd()) {
+          continue;
+        } else if (auto* gep = dyn_cast<GetElementPtrInst>(user)) {
+          auto* first = dyn_cast<ConstantInt>(gep->getOperand(1));
+          if (gep->getSourceElementType() != structType || use.getOperandNo() != 0 || gep->getNumIndices() < 2 ||
+              !first || !first->isZero()) {
+            return false;
+          }
+          geps.insert(gep);
+        } else if (auto* load = dyn_cast<LoadInst>(user)) {
+          if (!isFirstFieldAccess(load->getType())) {
+            return false;
+          }
+        } else if (auto* store = dyn_cast<StoreInst>(user)) {
+          if (use.getOperandNo() == 1) {
+            if (!isFirstFieldAccess(store->getValueOperand()->getType())) {
+              return false;
+            }
+          } else if (!addSlot(store->getPointerOperand())) {
+            return false;
+          }
+        } else if (auto* ret = dyn_cast<ReturnInst>(user)) {
+          calls.clear();
+          if (!getCalls(ret->getFunction(), calls)) {
+            return false;
+          }
+          for (CallInst* call : calls) {
+            worklist.push_back(call);
+          }
+        } else if (auto* call = dyn_cast<CallInst>(user)) {
+          Function* callee = call->getCalledFunction();
+          const TargetLibraryInfo& TLI = FAM.getResult<TargetLibraryAnalysis>(*call->getFunction());
+          LibFunc func;
+          if (!callee || call->isCallee(&use)) {
+            return false;
+          }
+          if (TLI.getLibFunc(*callee, func) && func == LibFunc_free) {
+            releases.insert(call);
+          } else if (callee->isDeclaration() || callee->isVarArg() || use.getOperandNo() >= callee->arg_size()) {
+            return false;
+          } else {
+            worklist.push_back(callee->getArg(use.getOperandNo()));
+          }
+        } else {
+          return false;
+        }
+      }
+    }
+    sites.geps.assign(geps.begin(), geps.end());
+    sites.allocations.assign(allocations.begin(), allocations.end());
+    sites.releases.assign(releases.begin(), releases.end());
+    return !sites.allocations.empty();
+  }
+
+  std::optional<SplitLayout> getSplitLayout(StructType* structType, std::set<unsigned>& hotFields,
+                                            const DataLayout& DL) {
+    LLVMContext& context = structType->getContext();
+    std::vector<Type*> hot, cold;
+    SplitLayout layout;
+    for (unsigned i = 0; i < structType->getNumElements(); ++i) {
+      auto& part = hotFields.count(i) ? hot : cold;
+      layout.fields.push_back({hotFields.count(i) > 0, part.size()});
+      part.push_back(structType->getElementType(i));
+    }
+    hot.push_back(Type::getInt8PtrTy(context));
+    //worth an extra pointer and allocation only if the hot part is at most half the node
+    uint64_t hotSize = DL.getTypeAllocSize(StructType::get(context, hot, structType->isPacked()));
+    if (alignTo(hotSize, 16) * 2 > alignTo(DL.getTypeAllocSize(structType), 16)) {
+      return std::nullopt;
+    }
+    std::string name = structType->hasName() ? structType->getName().str() : "anon";
+    layout.cold = StructType::create(context, cold, name + ".cold", structType->isPacked());
+    hot.back() = layout.cold->getPointerTo();
+    layout.hot = StructType::create(context, hot, name + ".hot", structType->isPacked());
+    return layout;
+  }
+
+  void splitStruct(SplitLayout& layout, NodeSites& sites, Module& M) {
+    const DataLayout& DL = M.getDataLayout();
+    Type* i32 = Type::getInt32Ty(M.getContext());
+    unsigned coldField = layout.hot->getNumElements() - 1;
+    auto getColdSlot = [&](IRBuilder<>& builder, Value* node) {
+      Value* hot = builder.CreateBitCast(node, layout.hot->getPointerTo());
+      return builder.CreateStructGEP(layout.hot, hot, coldField);
+    };
+
+    for (GetElementPtrInst* gep : sites.geps) {
+      IRBuilder<> builder(gep);
+      auto [isHot, index] = layout.fields[cast<ConstantInt>(gep->getOperand(2))->getZExtValue()];
+      std::vector<Value*> indices = {gep->getOperand(1), ConstantInt::get(i32, index)};
+      indices.insert(indices.end(), gep->idx_begin() + 2, gep->idx_end());
+      Value* part;
+      if (isHot) {
+        part = builder.CreateBitCast(gep->getPointerOperand(), layout.hot->getPointerTo());
+      } else {
+        part = builder.CreateLoad(layout.cold->getPointerTo(), getColdSlot(builder, gep->getPointerOperand()));
+      }
+      Value* replacement = gep->isInBounds()
+                               ? builder.CreateInBoundsGEP(isHot ? layout.hot : layout.cold, part, indices)
+                               : builder.CreateGEP(isHot ? layout.hot : layout.cold, part, indices);
+      replacement->takeName(gep);
+      gep->replaceAllUsesWith(builder.CreateBitCast(replacement, gep->getType()));
+      gep->eraseFromParent();
+    }
+
+    //the cold part is allocated with the node, calloc'd if the node is
+    for (CallInst* call : sites.allocations) {
+      unsigned sizeArg = call->arg_size() - 1;
+      Type* sizeType = call->getArgOperand(sizeArg)->getType();
+      auto* cold = cast<CallInst>(call->clone());
+      for (CallInst* part : {call, cold}) {
+        part->removeRetAttr(Attribute::Dereferenceable);
+        part->removeRetAttr(Attribute::DereferenceableOrNull);
+      }
+      call->setArgOperand(sizeArg, ConstantInt::get(sizeType, DL.getTypeAllocSize(layout.hot)));
+      cold->setArgOperand(sizeArg, ConstantInt::get(sizeType, DL.getTypeAllocSize(layout.cold)));
+      IRBuilder<> builder(call->getNextNode());
+      Value* allocated = builder.CreateIsNotNull(call);
+      Instruction* then = SplitBlockAndInsertIfThen(allocated, call->getNextNode()->getNextNode(), false);
+      builder.SetInsertPoint(then);
+      builder.Insert(cold, call->getName() + ".cold");
+      builder.CreateStore(builder.CreateBitCast(cold, layout.cold->getPointerTo()), getColdSlot(builder, call));
+    }
+
+    for (CallInst* call : sites.releases) {
+      IRBuilder<> builder(call);
+      Value* node = call->getArgOperand(0);
+      Instruction* then = SplitBlockAndInsertIfThen(builder.CreateIsNotNull(node), call, false);
+      builder.SetInsertPoint(then);
+      Value* cold = builder.CreateLoad(layout.cold->getPointerTo(), getColdSlot(builder, node));
+      builder.CreateCall(call->getFunctionType(), call->getCalledOperand(),
+                         {builder.CreateBitCast(cold, call->getArgOperand(0)->getType())});
+    }
+  }
+
+  bool splitStructs(Module& M, FunctionAnalysisManager& FAM, std::unordered_map<Function*, std::vector<Function*>>& sccOf) {
+    const DataLayout& DL = M.getDataLayout();
+    bool changed = false;
+    for (StructType* structType : getLayoutCandidates(M)) {
+      std::set<unsigned> hotFields = getHotFields(structType, M, FAM, sccOf);
+      NodeSites sites;
+      if (hotFields.size() == structType->getNumElements() || !getNodeSites(structType, M, FAM, sites)) {
+        continue;
+      }
+      if (sites.directAccess) {
+        hotFields.insert(0);
+      }
+      auto layout = getSplitLayout(structType, hotFields, DL);
+      if (!layout) {
+        continue;
+      }
+      splitStruct(*layout, sites, M);
+      for (auto& F : M) {
+        FAM.invalidate(F, PreservedAnalyses::none());
+      }
+      changed = true;
+    }
+    return changed;
+  }
+
+  /***
+   * Field reordering. The links and hot members of an RDS type are moved to the
+   * front, so the lines a traversal needs from a node are as few as the members
+   * allow, ideally just the first one that the entry prefetch fetches. Nodes are
+   * followed with the same legality check as splitting, and every GEP on the type
+   * is rewritten onto a reordered copy of it.
+  */
+  //the cache lines the given members of a line aligned node touch
+  unsigned getLinesTouched(StructType* structType, const std::vector<unsigned>& fields, const DataLayout& DL) {
+    const StructLayout* layout = DL.getStructLayout(structType);
+    std::set<uint64_t> lines;
+    for (unsigned field : fields) {
+      uint64_t begin = layout->getElementOffset(field);
+      uint64_t size = DL.getTypeStoreSize(structType->getElementType(field));
+      for (uint64_t line = begin / cacheLineSize; size && line <= (begin + size - 1) / cacheLineSize; ++line) {
+        lines.insert(line);
+      }
+    }
+    return lines.size();
+  }
+
+  bool reorderStructs(Module& M, FunctionAnalysisManager& FAM,
+                      std::unordered_map<Function*, std::vector<Function*>>& sccOf) {
+    const DataLayout& DL = M.getDataLayout();
+    LLVMContext& context = M.getContext();
+    cacheLineSize = CacheLineSize;
+    for (auto& F : M) {
+      if (cacheLineSize == 0 && !F.isDeclaration()) {
+        cacheLineSize = FAM.getResult<TargetIRAnalysis>(F).getCacheLineSize();
+      }
+    }
+    if (cacheLineSize == 0) {
+      cacheLineSize = 64;
+    }
+    bool changed = false;
+    for (StructType* structType : getLayoutCandidates(M)) {
+      if (structType->isPacked()) {
+        continue;
+      }
+      std::set<unsigned> hotFields = getHotFields(structType, M, FAM, sccOf);
+      NodeSites sites;
+      if (hotFields.empty() || hotFields.size() == structType->getNumElements() ||
+          !getNodeSites(structType, M, FAM, sites)) {
+        continue;
+      }
+
+      //the first member stays put if it is accessed through the node pointer, then
+      //links, then hot members, then the rest, each by decreasing alignment to keep padding down
+      std::vector<unsigned> order(structType->getNumElements());
+      std::iota(order.begin(), order.end(), 0);
+      auto rank = [&](unsigned field) {
+        if (field == 0 && sites.directAccess) {
+          return 0;
+        }
+        if (getFieldPointeeType(structType, field) == structType) {
+          return 1;
+        }
+        return hotFields.count(field) ? 2 : 3;
+      };
+      std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        if (rank(a) != rank(b)) {
+          return rank(a) < rank(b);
+        }
+        return DL.getABITypeAlign(structType->getElementType(a)) > DL.getABITypeAlign(structType->getElementType(b));
+      });
+      std::vector<Type*> elements;
+      std::vector<unsigned> position(order.size());
+      std::vector<unsigned> hotPositions;
+      for (unsigned i = 0; i < order.size(); ++i) {
+        position[order[i]] = i;
+        elements.push_back(structType->getElementType(order[i]));
+        if (rank(order[i]) < 3) {
+          hotPositions.push_back(i);
+        }
+      }
+      StructType* literal = StructType::get(context, elements);
+      std::vector<unsigned> hot;
+      for (unsigned i = 0; i < structType->getNumElements(); ++i) {
+        if (rank(i) < 3) {
+          hot.push_back(i);
+        }
+      }
+      //padding may only shrink, the nodes' memory is still allocated by the program
+      if (DL.getTypeAllocSize(literal) > DL.getTypeAllocSize(structType) ||
+          getLinesTouched(literal, hotPositions, DL) >= getLinesTouched(structType, hot, DL)) {
+        continue;
+      }
+
+      std::string name = structType->hasName() ? structType->getName().str() : "anon";
+      StructType* reordered = StructType::create(context, elements, name + ".reordered");
+      for (GetElementPtrInst* gep : sites.geps) {
+        IRBuilder<> builder(gep);
+        unsigned field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+        std::vector<Value*> indices = {gep->getOperand(1), builder.getInt32(position[field])};
+        indices.insert(indices.end(), gep->idx_begin() + 2, gep->idx_end());
+        Value* node = builder.CreateBitCast(gep->getPointerOperand(), reordered->getPointerTo());
+        Value* replacement = gep->isInBounds() ? builder.CreateInBoundsGEP(reordered, node, indices)
+                                               : builder.CreateGEP(reordered, node, indices);
+        replacement->takeName(gep);
+        gep->replaceAllUsesWith(builder.CreateBitCast(replacement, gep->getType()));
+        gep->eraseFromParent();
+      }
+      for (CallInst* call : sites.allocations) {
+        unsigned sizeArg = call->arg_size() - 1;
+        call->setArgOperand(sizeArg, ConstantInt::get(call->getArgOperand(sizeArg)->getType(),
+                                                      DL.getTypeAllocSize(reordered)));
+        call->removeRetAttr(Attribute::Dereferenceable);
+        call->removeRetAttr(Attribute::DereferenceableOrNull);
+      }
+      for (auto& F : M) {
+        FAM.invalidate(F, PreservedAnalyses::none());
+      }
+      changed = true;
+    }
+    return changed;
+  }
+
+  /***
+   * Pointer compression. The links of an RDS type are stored as 32 bit indices
+   * instead of pointers, so more nodes fit in a line and the traversal pulls in
+   * less memory. The nodes are allocated from a region pool that reserves one
+   * range of address space per type (runtime/pool.c), a link is the node's
+   * distance from the start of the region in GREEDY_REGION_GRANULE units, 0 being
+   * NULL, and is decoded where it is loaded. Every node has to come from the
+   * region, so the type passes the same legality check as splitting.
+  */
+  static constexpr const char* RegionAllocName = "__greedy_region_alloc";
+  static constexpr const char* RegionCallocName = "__greedy_region_calloc";
+  static constexpr unsigned RegionGranuleBits = 4; //log2 GREEDY_REGION_GRANULE
+
+  //region pool of each compressed link, by (struct, top level member)
+  std::map<std::pair<StructType*, size_t>, GlobalVariable*> compressedLinks;
+
+  Value* loadRegionBase(IRBuilder<>& builder, GlobalVariable* pool) {
+    StructType* poolType = getPoolType(builder.getContext());
+    return builder.CreateLoad(builder.getInt8PtrTy(), builder.CreateStructGEP(poolType, pool, 4), "region.base");
+  }
+
+  Value* decodeLink(IRBuilder<>& builder, Value* index, GlobalVariable* pool, Type* pointerType) {
+    Value* offset = builder.CreateShl(builder.CreateZExt(index, builder.getInt64Ty()), RegionGranuleBits);
+    Value* node = builder.CreateInBoundsGEP(builder.getInt8Ty(), loadRegionBase(builder, pool), offset);
+    return builder.CreateSelect(builder.CreateICmpEQ(index, builder.getInt32(0)),
+                                ConstantPointerNull::get(cast<PointerType>(pointerType)),
+                                builder.CreateBitCast(node, pointerType), "link");
+  }
+
+  Value* encodeLink(IRBuilder<>& builder, Value* node, GlobalVariable* pool) {
+    Value* address = builder.CreatePtrToInt(node, builder.getInt64Ty());
+    Value* base = builder.CreatePtrToInt(loadRegionBase(builder, pool), builder.getInt64Ty());
+    Value* index = builder.CreateTrunc(builder.CreateLShr(builder.CreateSub(address, base), RegionGranuleBits),
+                                       builder.getInt32Ty());
+    return builder.CreateSelect(builder.CreateIsNull(node), builder.getInt32(0), index, "link.index");
+  }
+
+  //the load of the index if v is a link decoded by decodeLink
+  LoadInst* getDecodedLink(Value* v) {
+    auto* select = dyn_cast<SelectInst>(v);
+    auto* isNull = select ? dyn_cast<ICmpInst>(select->getCondition()) : nullptr;
+    if (!isNull || isNull->getPredicate() != ICmpInst::ICMP_EQ || !isa<ConstantPointerNull>(select->getTrueValue())) {
+      return nullptr;
+    }
+    auto* index = dyn_cast<LoadInst>(isNull->getOperand(0));
+    auto* zero = dyn_cast<ConstantInt>(isNull->getOperand(1));
+    return index && index->getType()->isIntegerTy(32) && zero && zero->isZero() ? index : nullptr;
+  }
+
+  bool compressPointers(Module& M, FunctionAnalysisManager& FAM) {
+    const DataLayout& DL = M.getDataLayout();
+    LLVMContext& context = M.getContext();
+    Type* i32 = Type::getInt32Ty(context);
+    Type* i64 = Type::getInt64Ty(context);
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    if (!canRedirectReleases(M)) {
+      return false;
+    }
+    bool changed = false;
+    for (StructType* structType : getLayoutCandidates(M)) {
+      if (structType->isPacked() || !isRecursiveStruct(structType)) {
+        continue;
+      }
+      std::vector<Type*> elements(structType->element_begin(), structType->element_end());
+      std::set<unsigned> links;
+      for (unsigned i = 0; i < elements.size(); ++i) {
+        auto* array = dyn_cast<ArrayType>(elements[i]);
+        Type* slot = array ? array->getElementType() : elements[i];
+        if (slot->isPointerTy() && getFieldPointeeType(structType, i) == structType) {
+          links.insert(i);
+          elements[i] = array ? ArrayType::get(i32, array->getNumElements()) : i32;
+        }
+      }
+      //the region hands out nodes in 16 byte steps, so the node has to get smaller by at least that
+      if (links.empty() || alignTo(DL.getTypeAllocSize(StructType::get(context, elements)), 16) >=
+                                alignTo(DL.getTypeAllocSize(structType), 16)) {
+        continue;
+      }
+      NodeSites sites;
+      if (!getNodeSites(structType, M, FAM, sites) || (sites.directAccess && links.count(0))) {
+        continue;
+      }
+      //a link is only ever loaded or stored whole
+      bool rewritable = all_of(sites.geps, [&](GetElementPtrInst* gep) {
+        unsigned field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+        if (!links.count(field)) {
+          return true;
+        }
+        if (gep->getNumIndices() != (isa<ArrayType>(structType->getElementType(field)) ? 3u : 2u)) {
+          return false;
+        }
+        return all_of(gep->users(), [&](User* user) {
+          if (auto* load = dyn_cast<LoadInst>(user)) {
+            return load->isSimple() && load->getType()->isPointerTy();
+          }
+          auto* store = dyn_cast<StoreInst>(user);
+          return store && store->isSimple() && store->getPointerOperand() == gep &&
+                 store->getValueOperand()->getType()->isPointerTy();
+        });
+      });
+      if (!rewritable) {
+        continue;
+      }
+
+      std::string name = structType->hasName() ? structType->getName().str() : "anon";
+      StructType* compressed = StructType::create(context, elements, name + ".compressed");
+      GlobalVariable* pool = getOrCreatePool(M, compressed);
+      for (GetElementPtrInst* gep : sites.geps) {
+        IRBuilder<> builder(gep);
+        unsigned field = cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+        std::vector<Value*> indices(gep->idx_begin(), gep->idx_end());
+        Value* node = builder.CreateBitCast(gep->getPointerOperand(), compressed->getPointerTo());
+        Value* replacement = gep->isInBounds() ? builder.CreateInBoundsGEP(compressed, node, indices)
+                                               : builder.CreateGEP(compressed, node, indices);
+        replacement->takeName(gep);
+        if (!links.count(field)) {
+          gep->replaceAllUsesWith(builder.CreateBitCast(replacement, gep->getType()));
+          gep->eraseFromParent();
+          continue;
+        }
+        for (auto* user : make_early_inc_range(gep->users())) {
+          auto* access = cast<Instruction>(user);
+          builder.SetInsertPoint(access);
+          if (auto* load = dyn_cast<LoadInst>(access)) {
+            Value* index = builder.CreateLoad(i32, replacement, load->getName() + ".index");
+            Value* child = decodeLink(builder, index, pool, load->getType());
+            child->takeName(load);
+            load->replaceAllUsesWith(child);
+          } else {
+            auto* store = cast<StoreInst>(access);
+            builder.CreateStore(encodeLink(builder, store->getValueOperand(), pool), replacement);
+          }
+          access->eraseFromParent();
+        }
+        gep->eraseFromParent();
+      }
+
+      Type* poolPtr = getPoolType(context)->getPointerTo();
+      for (CallInst* call : sites.allocations) {
+        IRBuilder<> builder(call);
+        bool zeroed = call->arg_size() == 2;
+        FunctionCallee allocator = zeroed ? M.getOrInsertFunction(RegionCallocName, i8Ptr, poolPtr, i64, i64)
+                                          : M.getOrInsertFunction(RegionAllocName, i8Ptr, poolPtr, i64);
+        std::vector<Value*> args = {pool};
+        if (zeroed) {
+          args.push_back(builder.getInt64(1));
+        }
+        args.push_back(builder.getInt64(DL.getTypeAllocSize(compressed)));
+        CallInst* replacement = builder.CreateCall(allocator, args);
+        replacement->takeName(call);
+        call->replaceAllUsesWith(builder.CreateBitCast(replacement, call->getType()));
+        call->eraseFromParent();
+      }
+      for (unsigned field : links) {
+        compressedLinks[{compressed, field}] = pool;
+      }
+      for (auto& F : M) {
+        FAM.invalidate(F, PreservedAnalyses::none());
+      }
+      changed = true;
+    }
+    if (changed) {
+      redirectReleases(M);
+    }
+    return changed;
+  }
 
-  /**
-   * if a recursive call derives from an argument, this will return true
+  /***
+   * Helper thread run-ahead. A recursive traversal that does next to nothing per
+   * node can't hide its misses behind its own work, however early they are
+   * prefetched. Its address slice, the null check and the loads of the links it
+   * recurses on, is cloned into a function that the runtime runs on a helper
+   * thread (runtime/helper.c) from every call into the traversal, so an idle core
+   * brings the nodes into the shared cache first. The traversal counts the nodes
+   * it visits and the slice stays at most HelperLead nodes ahead of it, far
+   * enough to cover the latency without evicting lines before they are used.
+   * Only walks that recurse into all of their children, i.e. whose recursive
+   * calls share one block, visit nodes in the order the slice does. The slice
+   * reads the links while the traversal runs, so the traversal may neither
+   * store to them nor call anything that writes memory, e.g. free.
   */
-  bool isChainFromArgToCall(CallInst* instr, Argument* arg, Value* recurseVal){
-    //if the value is a store instruction we want to check 
-    //if we use the address later
-    if (auto* storeInst = dyn_cast<StoreInst>(recurseVal)) {
-      if (storeInst->getValueOperand() == arg || storeInst->getValueOperand() == recurseVal) {
-        recurseVal = storeInst->getPointerOperand();
-      }
+  static constexpr const char* HelperVisitedName = "__greedy_helper_visited";
+  static constexpr const char* HelperTouchedName = "__greedy_helper_touched";
+  //visits counted in a thread local before being added to the shared count, which
+  //the helper reads all the time, so its line isn't pulled over on every visit
+  static constexpr uint64_t HelperPublishInterval = 32;
+
+  struct RunAheadTraversal {
+    Function* traversal;
+    Argument* arg;      //the node the traversal is entered with
+    BasicBlock* visit;  //runs once per node, holds the recursive calls
+    StructType* nodeType;
+    std::vector<PrefetchInfo> children; //the links walked, in the order the traversal does
+  };
+
+  //the link member of *node that v is loaded from, a compressed one by way of its index
+  std::optional<std::vector<size_t>> getLinkLoadedFrom(Value* v, Value* node) {
+    v = v->stripPointerCasts();
+    LoadInst* load = getDecodedLink(v);
+    if (!load) {
+      load = dyn_cast<LoadInst>(v);
+    }
+    auto* gep = load ? dyn_cast<GetElementPtrInst>(load->getPointerOperand()->stripPointerCasts()) : nullptr;
+    if (!gep || gep->getNumIndices() < 2 || !gep->hasAllConstantIndices()) {
+      return std::nullopt;
+    }
+    auto* arg = dyn_cast<Argument>(node);
+    if (arg ? !isArgumentOrSpill(gep->getPointerOperand(), arg) : gep->getPointerOperand()->stripPointerCasts() != node) {
+      return std::nullopt;
+    }
+    std::vector<size_t> path;
+    for (unsigned i = 2; i < gep->getNumOperands(); ++i) {
+      path.push_back(cast<ConstantInt>(gep->getOperand(i))->getZExtValue());
     }
+    return path;
+  }
 
-    //don't cross function boundaries (maybe consider how this should work properly later)
-    if (auto* callInst = dyn_cast<CallInst>(recurseVal)) {
-      //errs() << "call inst, skipping. \n";
-      return false;
+  /***
+   * Returns the traversal if F walks every child of each node it is given. After
+   * tail recursion elimination the last child is walked by a loop instead, whose
+   * header phi starts at the argument and moves on to that child.
+  */
+  std::optional<RunAheadTraversal> getRunAheadTraversal(std::vector<Function*>& scc) {
+    Function* F = scc.front();
+    if (scc.size() != 1 || F->isVarArg()) {
+      return std::nullopt;
     }
-    if (auto* retInst = dyn_cast<ReturnInst>(recurseVal)) {
-      //errs() << "ret inst, skipping. \n";
-      return false;
+    std::vector<CallInst*> calls = getRecursiveCalls(*F, scc);
+    if (calls.empty() || any_of(calls, [&](CallInst* call) { return call->getParent() != calls[0]->getParent(); })) {
+      return std::nullopt;
+    }
+    for (auto& instr : instructions(*F)) {
+      auto* call = dyn_cast<CallBase>(&instr);
+      if (call && call->getCalledFunction() != F && !call->onlyReadsMemory() && !isa<DbgInfoIntrinsic>(call) &&
+          !call->isLifetimeStartOrEnd()) {
+        return std::nullopt;
+      }
     }
+    for (auto& arg : F->args()) {
+      StructType* nodeType = getArgumentStructType(&arg);
+      if (!nodeType || !isRecursiveStruct(nodeType)) {
+        continue;
+      }
+      std::vector<PrefetchInfo> links = getPrefetchInfoForStruct(nodeType);
+      auto getLink = [&](Value* v, Value* node) -> PrefetchInfo* {
+        auto path = getLinkLoadedFrom(v, node);
+        auto link = find_if(links, [&](PrefetchInfo& info) {
+          return path && info.gepOffsets == *path && info.countField < 0 && info.pointeeType == nodeType;
+        });
+        return link != links.end() ? &*link : nullptr;
+      };
+      bool storesLinks = any_of(instructions(*F), [&](Instruction& instr) {
+        auto* store = dyn_cast<StoreInst>(&instr);
+        auto* gep = store ? dyn_cast<GetElementPtrInst>(store->getPointerOperand()->stripPointerCasts()) : nullptr;
+        return gep && gep->getSourceElementType() == nodeType && gep->getNumIndices() >= 2 &&
+               any_of(links, [&](PrefetchInfo& info) {
+                 return info.gepOffsets[0] == cast<ConstantInt>(gep->getOperand(2))->getZExtValue();
+               });
+      });
+      if (storesLinks) {
+        continue;
+      }
 
-    //errs() << "instr: " << *instr << ", val: " << *val << "\n";
-    for (auto* user : recurseVal->users()){
-      //errs() << "   user: " <<  *user << "\n";
-      if (user == instr){
-        if (auto* inst = dyn_cast<Instruction>(user)){
-          for (unsigned i = 0; i < inst->getNumOperands(); ++i) {
-            Value *operand = inst->getOperand(i);
-            if (operand == recurseVal){
-              return true;
-            }
+      //the node the calls are made on, the argument or the phi of an eliminated tail call
+      Value* node = &arg;
+      PrefetchInfo* tail = nullptr;
+      for (PHINode& phi : calls[0]->getParent()->phis()) {
+        if (phi.getType() != arg.getType() || phi.getBasicBlockIndex(&F->getEntryBlock()) < 0 ||
+            phi.getIncomingValueForBlock(&F->getEntryBlock()) != &arg) {
+          continue;
+        }
+        PrefetchInfo* next = nullptr;
+        bool walksLink = true;
+        for (unsigned i = 0; i < phi.getNumIncomingValues(); ++i) {
+          if (phi.getIncomingBlock(i) == &F->getEntryBlock()) {
+            continue;
           }
+          PrefetchInfo* link = getLink(phi.getIncomingValue(i), &phi);
+          walksLink &= link && (!next || link == next);
+          next = link;
+        }
+        if (walksLink && next) {
+          node = &phi;
+          tail = next;
         }
-        //should never reach here
-        errs() << "ruh roh \n"; 
-        return false;
       }
-      if (isChainFromArgToCall(instr, arg, user)){
-        return true;
+
+      RunAheadTraversal traversal = {F, &arg, calls[0]->getParent(), nodeType, {}};
+      for (CallInst* call : calls) {
+        PrefetchInfo* link = getLink(call->getArgOperand(arg.getArgNo()), node);
+        if (!link) {
+          break;
+        }
+        traversal.children.push_back(*link);
+      }
+      if (traversal.children.size() == calls.size()) {
+        if (tail) {
+          traversal.children.push_back(*tail);
+        }
+        return traversal;
       }
     }
-    return false;
+    return std::nullopt;
   }
 
-  /****
-   * Returns a vector of call instructions within a given function that are recursive
+  /***
+   * Builds bool slice(void* node): returns false once the traversal is over,
+   * after touching node and the subtrees of the links the traversal recurses on.
+   * The last link is walked by a loop rather than a call, so a list or a
+   * degenerate tree doesn't take one frame of the helper's stack per node.
   */
-  std::vector<CallInst*> getRecursiveCalls(Function& F) {
-    std::vector<CallInst*> res;
-    for (auto& bb: F){
-      for (auto& instr: bb){
-        if (auto* callInst = dyn_cast<CallInst>(&instr)) {
-          if (auto* calledFunction = callInst->getCalledFunction()) {
-            if (calledFunction == &F){
-              res.push_back(callInst);
-            }
-          }
-        }
+  Function* createSlice(RunAheadTraversal& traversal, Module& M) {
+    LLVMContext& context = M.getContext();
+    Type* i64 = Type::getInt64Ty(context);
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    auto* sliceType = FunctionType::get(Type::getInt1Ty(context), {i8Ptr}, false);
+    Function* slice = Function::Create(sliceType, GlobalValue::InternalLinkage,
+                                       traversal.traversal->getName() + ".slice", M);
+    auto* visited = cast<GlobalVariable>(M.getOrInsertGlobal(HelperVisitedName, i64));
+    auto* touched = cast<GlobalVariable>(M.getOrInsertGlobal(HelperTouchedName, i64));
+    BasicBlock* entry = BasicBlock::Create(context, "entry", slice);
+    BasicBlock* header = BasicBlock::Create(context, "visit", slice);
+    BasicBlock* done = BasicBlock::Create(context, "done", slice);
+    BasicBlock* stop = BasicBlock::Create(context, "stop", slice);
+    BasicBlock* count = BasicBlock::Create(context, "count", slice);
+    BasicBlock* wait = BasicBlock::Create(context, "wait", slice);
+    BasicBlock* walk = BasicBlock::Create(context, "walk", slice);
+    IRBuilder<> builder(done);
+    builder.CreateRet(builder.getTrue());
+    builder.SetInsertPoint(stop);
+    builder.CreateRet(builder.getFalse());
+
+    builder.SetInsertPoint(entry);
+    builder.CreateBr(header);
+    builder.SetInsertPoint(header);
+    PHINode* node = builder.CreatePHI(i8Ptr, 2, "node");
+    node->addIncoming(slice->getArg(0), entry);
+    builder.CreateCondBr(builder.CreateIsNull(node), done, count);
+    //stopping resets the traversal's count, so the slice soon waits and is told to stop
+    builder.SetInsertPoint(count);
+    Value* touchedCount = builder.CreateAdd(builder.CreateLoad(i64, touched), builder.getInt64(1));
+    builder.CreateStore(touchedCount, touched);
+    LoadInst* visitedCount = builder.CreateAlignedLoad(i64, visited, Align(8));
+    visitedCount->setAtomic(AtomicOrdering::Monotonic);
+    Value* lead = builder.getInt64(HelperLead);
+    builder.CreateCondBr(builder.CreateICmpUGT(touchedCount, builder.CreateAdd(visitedCount, lead)), wait, walk);
+    builder.SetInsertPoint(wait);
+    FunctionCallee waitFunction = M.getOrInsertFunction("__greedy_helper_wait", builder.getInt1Ty(), i64);
+    builder.CreateCondBr(builder.CreateCall(waitFunction, {lead}), walk, stop);
+
+    builder.SetInsertPoint(walk);
+    Value* zero = builder.getInt32(0);
+    for (size_t i = 0; i < traversal.children.size(); ++i) {
+      PrefetchInfo& info = traversal.children[i];
+      std::vector<Value*> indexes = {zero};
+      for (auto offset : info.gepOffsets) {
+        indexes.push_back(builder.getInt32(offset));
+      }
+      Value* address = builder.CreateInBoundsGEP(traversal.nodeType,
+                                                 castToStruct(builder, node, traversal.nodeType), indexes);
+      Value* child = builder.CreateBitCast(loadChild(builder, info, address, "child"), i8Ptr);
+      if (i + 1 == traversal.children.size()) {
+        node->addIncoming(child, builder.GetInsertBlock());
+        builder.CreateBr(header);
+        break;
       }
+      BasicBlock* next = BasicBlock::Create(context, "walk", slice);
+      builder.CreateCondBr(builder.CreateCall(slice, {child}), next, stop);
+      builder.SetInsertPoint(next);
     }
-    return res;
+    return slice;
   }
 
-  /****
-   * Returns a vector of call instructions within a given function that are chain recursive
-  */
-  std::vector<CallInst*> getChainRecursiveCalls(Function& F, CallGraph* CG) {
-    std::vector<CallInst*> res;
-    for (auto& bb: F){
-      for (auto& instr: bb){
-        if (auto* callInst = dyn_cast<CallInst>(&instr)) {
-          if (auto* calledFunction = callInst->getCalledFunction()) {
-            // Instead of checking if the function calls itself, we check if the two functions call each other
-            if (calleeCallsCaller(F, *calledFunction, CG)){
-              res.push_back(callInst);
-            }
-          }
+  bool runAheadTraversals(Module& M, std::vector<std::vector<Function*>>& sccs) {
+    LLVMContext& context = M.getContext();
+    Type* i32 = Type::getInt32Ty(context);
+    Type* i64 = Type::getInt64Ty(context);
+    Type* i8Ptr = Type::getInt8PtrTy(context);
+    bool changed = false;
+    for (auto& scc : sccs) {
+      auto traversal = getRunAheadTraversal(scc);
+      if (!traversal) {
+        continue;
+      }
+      //entered from outside, where the helper is started and stopped
+      std::vector<CallInst*> entries;
+      for (auto* user : traversal->traversal->users()) {
+        auto* call = dyn_cast<CallInst>(user);
+        if (call && call->getCalledOperand() == traversal->traversal && call->getFunction() != traversal->traversal) {
+          entries.push_back(call);
         }
       }
-    }
-    return res;
-  }
+      if (entries.empty()) {
+        continue;
+      }
 
-  /***
-   * For now this just checks if two functions directly call each other
-   * Since caller calls callee, it suffices to check if callee calls caller
-  ***/
-  bool calleeCallsCaller(Function& caller, Function& callee, CallGraph* CG) {
-    CallGraphNode* calleeNode = (*CG)[&callee];
-    for(auto callRecord = calleeNode->begin(); callRecord != calleeNode->end(); ++callRecord) {
-      CallGraphNode* candidateNode = callRecord->second;
-      if(candidateNode->getFunction() == &caller) {
-        return true;
+      Function* slice = createSlice(*traversal, M);
+      FunctionCallee start = M.getOrInsertFunction("__greedy_helper_start", i32, slice->getType(), i8Ptr);
+      FunctionCallee stop = M.getOrInsertFunction("__greedy_helper_stop", Type::getVoidTy(context), i32);
+      for (CallInst* call : entries) {
+        IRBuilder<> builder(call);
+        Value* root = builder.CreateBitCast(call->getArgOperand(traversal->arg->getArgNo()), i8Ptr);
+        Value* started = builder.CreateCall(start, {slice, root}, "helper.started");
+        builder.SetInsertPoint(call->getNextNode());
+        builder.CreateCall(stop, {started});
       }
+
+      //count every node whose children the traversal recurses into
+      IRBuilder<> builder(&*traversal->visit->getFirstInsertionPt());
+      auto* visited = cast<GlobalVariable>(M.getOrInsertGlobal(HelperVisitedName, i64));
+      auto* pending = new GlobalVariable(M, i64, false, GlobalValue::InternalLinkage, builder.getInt64(0),
+                                         "__greedy_helper_pending." + traversal->traversal->getName());
+      pending->setThreadLocal(true);
+      Value* count = builder.CreateAdd(builder.CreateLoad(i64, pending), builder.getInt64(1), "helper.pending");
+      builder.CreateStore(count, pending);
+      Value* publish = builder.CreateICmpEQ(builder.CreateURem(count, builder.getInt64(HelperPublishInterval)),
+                                            builder.getInt64(0));
+      Instruction* then = SplitBlockAndInsertIfThen(publish, &*builder.GetInsertPoint(), false);
+      then->getParent()->setName("helper.publish");
+      builder.SetInsertPoint(then);
+      //an add rather than a load and store, other threads may run the traversal too
+      builder.CreateAtomicRMW(AtomicRMWInst::Add, visited, builder.getInt64(HelperPublishInterval), Align(8),
+                              AtomicOrdering::Monotonic);
+      changed = true;
     }
-    return false;
+    return changed;
   }
 
-  //generate one of these structs for every element we want to prefetch
-  struct PrefetchInfo {
-    std::vector<size_t>  gepOffsets;
-    PointerType* structPointerType; //pointer to the struct that we are prefetching
+  /***
+   * Interleaving, in the style of AMAC. A loop that calls a lookup once per
+   * iteration, e.g. for (i...) d = HashLookup(key[i], table), waits for one chain
+   * of misses after the other, and prefetching inside a lookup can't help much as
+   * each node's address comes from the previous one. The lookup is cut into a
+   * start, its code up to the pointer chasing loop, and a step, one iteration of
+   * that loop, both of which yield the node to go on with after prefetching it.
+   * The caller keeps InterleaveGroup lookups in flight, of the iterations ahead
+   * of it, and steps them in turn, so their misses overlap. A lookup may only
+   * read memory and must keep all its state in the node and its arguments, and
+   * the arguments of later iterations have to be computable ahead of time: from
+   * the induction variable, loop invariants, and memory the loop doesn't write.
+  */
+  //the lookup's pointer chasing loop
+  struct Lookup {
+    Loop* loop;
+    PHINode* node;
+    std::set<BasicBlock*> region; //the loop and everything after it
   };
 
-  /***
-    * Returns a map from argument of function args to offsets of record pointer members
-  ***/
- // TODO: check that structs are not opaque before peering into them
-  std::unordered_map<Value*, std::vector<PrefetchInfo>> getPrefetchInfoForArguments(Function &F) {
-    /***
-      * For each function arg typ
-      *   if type dyncasts to struct ptr
-      *     For each member type of arg
-      *       if member type dyncasts to struct ptr
-      *         add offset to result vector
-    ***/
-    std::unordered_map<Value*, std::vector<PrefetchInfo>> offsets;
+  //a lookup called once per iteration of a counted loop
+  struct InterleaveSite {
+    CallInst* call;
+    Loop* loop;
+    PHINode* induction;  //null if no argument depends on it
+    ConstantInt* step;
+    std::vector<Instruction*> slice; //compute the arguments, in program order
+  };
 
-    auto arglist = F.args();
-    
-    for (auto* a = arglist.begin(); a != arglist.end(); ++a){
-      if (auto* ptr = dyn_cast<PointerType>(a->getType())) {
-        if (auto* innerType = dyn_cast<StructType>(ptr->getPointerElementType())) {
-          //innerType is the if we have T* a as an arg then inner type is T
-          for (size_t i = 0; i < innerType->getNumElements(); ++i) {
-            //if T = {T0 a, T1 b, ..., TN z} then argumentFieldType is Ti
-            auto* argumentFieldType = innerType->getTypeAtIndex(i);
-            //case 1 we have a direct  pointer to a struct
-            if (auto* argumentFieldPtrType = dyn_cast<PointerType>(argumentFieldType)) {
-              if (auto* fieldInnerType = dyn_cast<StructType>(argumentFieldPtrType->getPointerElementType())) {
-                offsets[a].push_back({{i}, argumentFieldPtrType});
-              }
-            }
-            //case 2 we have an array of pointers to structs
-            if (auto* argumentFieldArayType = dyn_cast<ArrayType>(argumentFieldType)){
-              if (auto* argumentFieldArrayElementType = dyn_cast<PointerType>(argumentFieldArayType->getElementType())){
-                if (auto* argumentFieldArrayElementPointeeType = dyn_cast<StructType>(argumentFieldArrayElementType->getElementType())){
-                  //push a new PrefetchInfo for each element of the array
-                  for (size_t j = 0; j < argumentFieldArayType->getNumElements(); ++j){
-                    offsets[a].push_back({{i, j}, argumentFieldArrayElementType});
-                  }
-                }
-              }
-            }
+  std::optional<Lookup> getLookup(Function* F, FunctionAnalysisManager& FAM) {
+    if (F->isDeclaration() || F->isVarArg() || !F->onlyReadsMemory()) {
+      return std::nullopt;
+    }
+    LoopInfo& LI = FAM.getResult<LoopAnalysis>(*F);
+    if (LI.getTopLevelLoops().size() != 1 || !LI.getTopLevelLoops()[0]->getSubLoops().empty()) {
+      return std::nullopt;
+    }
+    Loop* L = LI.getTopLevelLoops()[0];
+    std::vector<PointerChase> chases = getPointerChasingLoops(LI);
+    BasicBlock* header = L->getHeader();
+    if (chases.size() != 1 || !L->getLoopPredecessor() || !L->getLoopLatch() ||
+        &*header->phis().begin() != chases[0].node || std::next(header->phis().begin()) != header->phis().end()) {
+      return std::nullopt;
+    }
+    Lookup lookup = {L, chases[0].node, {}};
+    SmallVector<BasicBlock*, 16> worklist = {header};
+    while (!worklist.empty()) {
+      BasicBlock* bb = worklist.pop_back_val();
+      if (lookup.region.insert(bb).second) {
+        worklist.append(succ_begin(bb), succ_end(bb));
+      }
+    }
+    //a step starts at the loop header, nothing computed before it is there
+    for (BasicBlock* bb : lookup.region) {
+      for (auto& instr : *bb) {
+        auto* phi = dyn_cast<PHINode>(&instr);
+        for (unsigned i = 0; i < instr.getNumOperands(); ++i) {
+          auto* operand = dyn_cast<Instruction>(instr.getOperand(i));
+          if (phi && !lookup.region.count(phi->getIncomingBlock(i))) {
+            continue;
+          }
+          if (operand && !lookup.region.count(operand->getParent())) {
+            return std::nullopt;
           }
         }
+        auto* call = dyn_cast<CallInst>(&instr);
+        if (call && call->getCalledFunction() == F) {
+          return std::nullopt;
+        }
       }
     }
-    return offsets;
+    return lookup;
   }
 
-  size_t countInstructions(BasicBlock& bb){
-    size_t c = 0;
-    for (auto& ins : bb){
-      ++c;
+  std::optional<InterleaveSite> getInterleaveSite(CallInst* call, LoopInfo& LI, DominatorTree& DT,
+                                                  ScalarEvolution& SE, AAResults& AA) {
+    Loop* L = LI.getLoopFor(call->getParent());
+    BasicBlock* latch = L ? L->getLoopLatch() : nullptr;
+    //runs exactly once per iteration, for a number of iterations known on entry
+    if (!latch || !L->getLoopPredecessor() || L->getExitingBlock() != latch ||
+        !DT.dominates(call->getParent(), latch) || isa<SCEVCouldNotCompute>(SE.getBackedgeTakenCount(L))) {
+      return std::nullopt;
+    }
+    //lookups of later iterations run before this iteration's writes, none may change what they read
+    for (BasicBlock* bb : L->blocks()) {
+      for (auto& other : *bb) {
+        if (&other == call || !other.mayWriteToMemory()) {
+          continue;
+        }
+        auto* otherCall = dyn_cast<CallBase>(&other);
+        auto location = MemoryLocation::getOrNone(&other);
+        if (otherCall ? isModSet(AA.getModRefInfo(otherCall, call))
+                      : !location || isRefSet(AA.getModRefInfo(call, *location))) {
+          return std::nullopt;
+        }
+      }
+    }
+    InterleaveSite site = {call, L, nullptr, nullptr, {}};
+    SmallPtrSet<Instruction*, 16> slice;
+    SmallVector<Value*, 16> worklist(call->args());
+    while (!worklist.empty()) {
+      auto* instr = dyn_cast<Instruction>(worklist.pop_back_val());
+      if (!instr || !L->contains(instr) || !slice.insert(instr).second) {
+        continue;
+      }
+      if (auto* phi = dyn_cast<PHINode>(instr)) {
+        auto* rec = phi->getType()->isIntegerTy() ? dyn_cast<SCEVAddRecExpr>(SE.getSCEV(phi)) : nullptr;
+        auto* step = rec && rec->isAffine() ? dyn_cast<SCEVConstant>(rec->getStepRecurrence(SE)) : nullptr;
+        if (site.induction || phi->getParent() != L->getHeader() || !step || rec->getLoop() != L) {
+          return std::nullopt;
+        }
+        site.induction = phi;
+        site.step = step->getValue();
+        continue;
+      }
+      if (instr->mayHaveSideEffects() || (isa<CallBase>(instr) && instr->mayReadOrWriteMemory())) {
+        return std::nullopt;
+      }
+      if (auto* load = dyn_cast<LoadInst>(instr)) {
+        //read ahead of the iterations before it
+        if (!load->isSimple()) {
+          return std::nullopt;
+        }
+        for (BasicBlock* bb : L->blocks()) {
+          for (auto& other : *bb) {
+            if (other.mayWriteToMemory() && isModSet(AA.getModRefInfo(&other, MemoryLocation::get(load)))) {
+              return std::nullopt;
+            }
+          }
+        }
+      } else if (instr->mayReadFromMemory()) {
+        return std::nullopt;
+      }
+      worklist.append(instr->op_begin(), instr->op_end());
+    }
+    //in reverse post order every definition comes before its uses
+    ReversePostOrderTraversal<Function*> order(call->getFunction());
+    for (BasicBlock* bb : order) {
+      for (auto& instr : *bb) {
+        if (slice.count(&instr) && &instr != site.induction) {
+          site.slice.push_back(&instr);
+        }
+      }
     }
-    return c;
+    return site;
   }
 
   /***
-  * Generates prefetch instructions for given RDS (greedily prefetch entire RDS)
+   * Clones the lookup into a start (resume false) taking its arguments or a step
+   * (resume true) also taking the node to go on with. Both return { i1 done, node,
+   * result }: done with the lookup's result, or the node after prefetching it.
   */
-  void genAndInsertPrefetchInstructions(Value* arg, std::vector<PrefetchInfo>& offsets, Function& F) {
-    /***
-     * Steps:
-     * 1. Load the argument (this is the address of arg now)
-     * For each offset:
-     *   - Compute address of struct element
-     *   - Prefetch addres
-     * Total instructions 1 + 2 * (num_offsets)
-    */
-    LLVMContext& context = F.getContext();
-    Value* nullValue = ConstantPointerNull::get(cast<PointerType>(arg->getType()));
+  Function* createLookupPart(Function* F, Lookup& lookup, StructType* resultType, bool resume) {
+    std::vector<Type*> params(F->getFunctionType()->param_begin(), F->getFunctionType()->param_end());
+    if (resume) {
+      params.push_back(lookup.node->getType());
+    }
+    Function* part = Function::Create(FunctionType::get(resultType, params, false), GlobalValue::InternalLinkage,
+                                      F->getName() + (resume ? ".step" : ".start"), F->getParent());
+    ValueToValueMapTy VMap;
+    for (auto& arg : F->args()) {
+      VMap[&arg] = part->getArg(arg.getArgNo());
+    }
+    SmallVector<ReturnInst*, 4> returns;
+    CloneFunctionInto(part, F, VMap, CloneFunctionChangeType::LocalChangesOnly, returns);
 
-    // Create the comparison instruction
-   
-    BasicBlock* originalFirstBlock = &F.getEntryBlock();
-    BasicBlock* entry = BasicBlock::Create(context, "check-arg", &F, originalFirstBlock);
-    IRBuilder<> builder(context);
-    builder.SetInsertPoint(entry);
-    Value* isNonNull = builder.CreateICmpNE(arg, nullValue, "isNonNull");
-    BasicBlock *conditionalBlock = BasicBlock::Create(context, "conditional", &F, originalFirstBlock);
-    builder.CreateCondBr(isNonNull, conditionalBlock, originalFirstBlock);
-    builder.SetInsertPoint(conditionalBlock);
+    Value* poison = PoisonValue::get(lookup.node->getType());
+    for (ReturnInst* ret : returns) {
+      IRBuilder<> builder(ret);
+      Value* result = builder.CreateInsertValue(UndefValue::get(resultType), builder.getTrue(), 0);
+      result = builder.CreateInsertValue(result, poison, 1);
+      if (ret->getReturnValue()) {
+        result = builder.CreateInsertValue(result, ret->getReturnValue(), 2);
+      }
+      builder.CreateRet(result);
+      ret->eraseFromParent();
+    }
 
-    auto eltT = arg->getType()->getPointerElementType();
+    auto* header = cast<BasicBlock>(VMap[lookup.loop->getHeader()]);
+    auto* node = cast<PHINode>(VMap[lookup.node]);
+    //the prefetch and yield, in place of the edge into the loop for a start and of the backedge for a step
+    BasicBlock* from = cast<BasicBlock>(VMap[resume ? lookup.loop->getLoopLatch() : lookup.loop->getLoopPredecessor()]);
+    BasicBlock* yield = BasicBlock::Create(part->getContext(), "yield", part);
+    IRBuilder<> builder(yield);
+    Value* next = node->getIncomingValueForBlock(from);
+    emitPrefetch(builder, next, *part);
+    Value* result = builder.CreateInsertValue(UndefValue::get(resultType), builder.getFalse(), 0);
+    builder.CreateRet(builder.CreateInsertValue(result, next, 1));
+    from->getTerminator()->replaceSuccessorWith(header, yield);
+    node->removeIncomingValue(from);
 
-    Value* zero = ConstantInt::get(Type::getInt32Ty(context), 0);
-    for (auto& [offsets, prefetchPointerType] : offsets) {
-        Function* prefetchFunc = Intrinsic::getDeclaration(F.getParent(), Intrinsic::prefetch, prefetchPointerType);
-        // Compute address of struct element using byte offset
-        std::vector<Value*> offsetValues = {zero};
-        for (auto offset : offsets){
-          offsetValues.push_back(ConstantInt::get(Type::getInt32Ty(context), offset));
-        }
-        auto indexes =  ArrayRef<Value*>(offsetValues);
-        //errs() << " offsets: " << indexes << " \n";
-        Value* elementAddr = builder.CreateInBoundsGEP(eltT, arg, indexes, "");
-        Value* loadPtr = builder.CreateLoad(prefetchPointerType, elementAddr, "");
+    if (resume) {
+      BasicBlock* entry = BasicBlock::Create(part->getContext(), "resume", part, &part->getEntryBlock());
+      BranchInst::Create(header, entry);
+      node->replaceAllUsesWith(part->getArg(params.size() - 1));
+      node->eraseFromParent();
+    }
+    removeUnreachableBlocks(*part);
+    return part;
+  }
 
-       // builder.CreateGEP(loadedArg->getType()->getPointerElementType(), loadedArg, offsetValue);
+  void interleave(InterleaveSite& site, Function* start, Function* step, ScalarEvolution& SE) {
+    CallInst* call = site.call;
+    Function* F = call->getFunction();
+    Module& M = *F->getParent();
+    LLVMContext& context = F->getContext();
+    const DataLayout& DL = M.getDataLayout();
+    Type* i64 = Type::getInt64Ty(context);
+    unsigned group = InterleaveGroup;
+    auto* resultType = cast<StructType>(start->getReturnType());
+    unsigned numArgs = call->arg_size();
 
-        // Prefetch address
-        // 0 = read, 3 = high locality, 1 = data cache
-        std::vector<Value*> args = {
-            loadPtr,
-            ConstantInt::get(Type::getInt32Ty(context), 0), // rw = 0 (read)
-            ConstantInt::get(Type::getInt32Ty(context), 3), // locality
-            ConstantInt::get(Type::getInt32Ty(context), 1)  // cache type (data cache)
-        };
+    //one lane per lookup in flight: { arguments..., node, done, result }
+    std::vector<Type*> fields(call->getFunctionType()->param_begin(), call->getFunctionType()->param_end());
+    fields.push_back(resultType->getElementType(1));
+    fields.push_back(Type::getInt1Ty(context));
+    if (resultType->getNumElements() > 2) {
+      fields.push_back(resultType->getElementType(2));
+    }
+    StructType* laneType = StructType::get(context, fields);
+    IRBuilder<> builder(&*F->getEntryBlock().getFirstInsertionPt());
+    AllocaInst* lanes = builder.CreateAlloca(ArrayType::get(laneType, group), nullptr, "lanes");
+    AllocaInst* issuedSlot = builder.CreateAlloca(i64, nullptr, "issued");
+    AllocaInst* iterationSlot = builder.CreateAlloca(i64, nullptr, "iteration");
+    auto getLaneField = [&](Value* lane, unsigned field) {
+      return builder.CreateInBoundsGEP(lanes->getAllocatedType(), lanes, {builder.getInt64(0), lane,
+                                                                          builder.getInt32(field)});
+    };
+    auto storeResult = [&](Value* lane, Value* result) {
+      builder.CreateStore(builder.CreateExtractValue(result, 1), getLaneField(lane, numArgs));
+      builder.CreateStore(builder.CreateExtractValue(result, 0), getLaneField(lane, numArgs + 1));
+      if (resultType->getNumElements() > 2) {
+        builder.CreateStore(builder.CreateExtractValue(result, 2), getLaneField(lane, numArgs + 2));
+      }
+    };
 
-        builder.CreateCall(prefetchFunc->getFunctionType(), prefetchFunc, args, "");
+    BasicBlock* preheader = site.loop->getLoopPreheader();
+    builder.SetInsertPoint(preheader->getTerminator());
+    SCEVExpander expander(SE, DL, "interleave");
+    const SCEV* tripCount = SE.getTripCountFromExitCount(SE.getBackedgeTakenCount(site.loop));
+    Value* iterations = builder.CreateZExtOrTrunc(
+        expander.expandCodeFor(tripCount, tripCount->getType(), preheader->getTerminator()), i64, "iterations");
+    builder.CreateStore(builder.getInt64(0), issuedSlot);
+    builder.CreateStore(builder.getInt64(0), iterationSlot);
+    for (unsigned lane = 0; lane < group; ++lane) {
+      builder.CreateStore(builder.getTrue(), getLaneField(builder.getInt64(lane), numArgs + 1));
     }
-    builder.CreateBr(originalFirstBlock);
-    originalFirstBlock->moveAfter(conditionalBlock);
-  }
-  
-  /***
-   * Returns map from call to vector of Arguments that it relies on
-  */
-  std::unordered_map<Value*, std::vector<CallInst*>> getArgumentsToCallsThatNeedIt(Function &F, CallGraph* CG = nullptr) {
-    std::unordered_map<Value*, std::vector<CallInst*>> output;
-    auto arglist = F.args();
-    std::vector<CallInst*> recursiveCalls = (CG != nullptr) ? getChainRecursiveCalls(F, CG) : getRecursiveCalls(F);
 
-    //the function isn't recursive so its not a candidate for this optimization.
-    if (recursiveCalls.empty()){
-      return output;
+    BasicBlock* before = call->getParent();
+    BasicBlock* consume = before->splitBasicBlock(call, "interleave.consume");
+    BasicBlock* refillCheck = BasicBlock::Create(context, "interleave.refill.check", F, consume);
+    BasicBlock* refill = BasicBlock::Create(context, "interleave.refill", F, consume);
+    BasicBlock* driveCheck = BasicBlock::Create(context, "interleave.drive", F, consume);
+    BasicBlock* round = BasicBlock::Create(context, "interleave.round", F, consume);
+    BasicBlock* roundStep = BasicBlock::Create(context, "interleave.step", F, consume);
+    BasicBlock* roundNext = BasicBlock::Create(context, "interleave.next", F, consume);
+    before->getTerminator()->setSuccessor(0, refillCheck);
+
+    //start the lookups of the iterations up to group - 1 ahead
+    builder.SetInsertPoint(refillCheck);
+    Value* issued = builder.CreateLoad(i64, issuedSlot, "issued");
+    Value* iteration = builder.CreateLoad(i64, iterationSlot, "iteration");
+    Value* ahead = builder.CreateAdd(iteration, builder.getInt64(group));
+    Value* limit = builder.CreateSelect(builder.CreateICmpULT(ahead, iterations), ahead, iterations);
+    builder.CreateCondBr(builder.CreateICmpULT(issued, limit), refill, driveCheck);
+
+    builder.SetInsertPoint(refill);
+    ValueToValueMapTy VMap;
+    if (site.induction) {
+      Type* inductionType = site.induction->getType();
+      Value* distance = builder.CreateTrunc(builder.CreateSub(issued, iteration), inductionType);
+      VMap[site.induction] = builder.CreateAdd(site.induction, builder.CreateMul(distance, site.step));
+    }
+    for (Instruction* instr : site.slice) {
+      Instruction* clone = instr->clone();
+      RemapInstruction(clone, VMap, RF_IgnoreMissingLocals | RF_NoModuleLevelChanges);
+      builder.Insert(clone, instr->getName() + ".ahead");
+      VMap[instr] = clone;
     }
+    Value* lane = builder.CreateURem(issued, builder.getInt64(group), "lane");
+    std::vector<Value*> args;
+    for (unsigned i = 0; i < numArgs; ++i) {
+      Value* arg = call->getArgOperand(i);
+      args.push_back(VMap.count(arg) ? (Value*)VMap[arg] : arg);
+      builder.CreateStore(args.back(), getLaneField(lane, i));
+    }
+    std::vector<CallInst*> parts = {builder.CreateCall(start, args)};
+    storeResult(lane, parts.back());
+    builder.CreateStore(builder.CreateAdd(issued, builder.getInt64(1)), issuedSlot);
+    builder.CreateBr(refillCheck);
 
-    for (auto arg = arglist.begin(); arg != arglist.end(); ++arg){
-      for (auto* recursiveCall : recursiveCalls){
-        if (isChainFromArgToCall(recursiveCall, arg, arg)) {
-          output[arg].push_back(recursiveCall);
+    //step every lookup in flight until this iteration's is done
+    builder.SetInsertPoint(driveCheck);
+    Value* current = builder.CreateURem(iteration, builder.getInt64(group), "lane");
+    builder.CreateCondBr(builder.CreateLoad(builder.getInt1Ty(), getLaneField(current, numArgs + 1)), consume, round);
+
+    builder.SetInsertPoint(round);
+    PHINode* other = builder.CreatePHI(i64, 2, "lane");
+    other->addIncoming(builder.getInt64(0), driveCheck);
+    builder.CreateCondBr(builder.CreateLoad(builder.getInt1Ty(), getLaneField(other, numArgs + 1)), roundNext,
+                         roundStep);
+    builder.SetInsertPoint(roundStep);
+    args.clear();
+    for (unsigned i = 0; i <= numArgs; ++i) {
+      args.push_back(builder.CreateLoad(fields[i], getLaneField(other, i)));
+    }
+    parts.push_back(builder.CreateCall(step, args));
+    storeResult(other, parts.back());
+    builder.CreateBr(roundNext);
+    builder.SetInsertPoint(roundNext);
+    Value* nextLane = builder.CreateAdd(other, builder.getInt64(1));
+    other->addIncoming(nextLane, roundNext);
+    builder.CreateCondBr(builder.CreateICmpEQ(nextLane, builder.getInt64(group)), driveCheck, round);
+
+    builder.SetInsertPoint(call);
+    if (!call->getType()->isVoidTy()) {
+      Value* result = builder.CreateLoad(call->getType(), getLaneField(current, numArgs + 2));
+      result->takeName(call);
+      call->replaceAllUsesWith(result);
+    }
+    builder.CreateStore(builder.CreateAdd(iteration, builder.getInt64(1)), iterationSlot);
+    call->eraseFromParent();
+
+    for (CallInst* part : parts) {
+      InlineFunctionInfo info;
+      InlineFunction(*part, info);
+    }
+    DominatorTree DT(*F);
+    PromoteMemToReg({issuedSlot, iterationSlot}, DT);
+  }
+
+  bool interleaveLookups(Module& M, FunctionAnalysisManager& FAM) {
+    std::map<Function*, std::optional<Lookup>> lookups;
+    bool changed = false;
+    for (auto& F : M) {
+      if (F.isDeclaration() || F.hasOptNone()) {
+        continue;
+      }
+      std::vector<CallInst*> calls;
+      std::set<Loop*> loops;
+      for (auto& instr : instructions(F)) {
+        auto* call = dyn_cast<CallInst>(&instr);
+        Function* callee = call ? call->getCalledFunction() : nullptr;
+        if (!callee || callee == &F || call->isMustTailCall()) {
+          continue;
+        }
+        if (!lookups.count(callee)) {
+          lookups[callee] = getLookup(callee, FAM);
+        }
+        if (!lookups[callee]) {
+          continue;
+        }
+        auto site = getInterleaveSite(call, FAM.getResult<LoopAnalysis>(F), FAM.getResult<DominatorTreeAnalysis>(F),
+                                      FAM.getResult<ScalarEvolutionAnalysis>(F), FAM.getResult<AAManager>(F));
+        //one lookup per loop, the others' arguments could depend on it
+        if (site && loops.insert(site->loop).second) {
+          calls.push_back(call);
+        }
+      }
+      if (calls.empty() || InterleaveGroup < 2) {
+        continue;
+      }
+      //each rewrite changes the function, so the analyses are recomputed for the next site
+      for (CallInst* call : calls) {
+        auto found = getInterleaveSite(call, FAM.getResult<LoopAnalysis>(F), FAM.getResult<DominatorTreeAnalysis>(F),
+                                       FAM.getResult<ScalarEvolutionAnalysis>(F), FAM.getResult<AAManager>(F));
+        if (!found) {
+          continue;
+        }
+        InterleaveSite& site = *found;
+        Function* callee = site.call->getCalledFunction();
+        Lookup& lookup = *lookups[callee];
+        std::vector<Type*> result = {Type::getInt1Ty(M.getContext()), lookup.node->getType()};
+        if (!callee->getReturnType()->isVoidTy()) {
+          result.push_back(callee->getReturnType());
         }
+        StructType* resultType = StructType::get(M.getContext(), result);
+        //the lanes are set up on the way into the loop only
+        if (!site.loop->getLoopPreheader()) {
+          SplitEdge(site.loop->getLoopPredecessor(), site.loop->getHeader(),
+                    &FAM.getResult<DominatorTreeAnalysis>(F), &FAM.getResult<LoopAnalysis>(F));
+        }
+        Function* start = createLookupPart(callee, lookup, resultType, false);
+        Function* step = createLookupPart(callee, lookup, resultType, true);
+        interleave(site, start, step, FAM.getResult<ScalarEvolutionAnalysis>(F));
+        start->eraseFromParent();
+        step->eraseFromParent();
+        FAM.invalidate(F, PreservedAnalyses::none());
+        changed = true;
       }
     }
-    return output;
+    return changed;
   }
-  
 
-  PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
-    Module* M = F.getParent();
-    llvm::CallGraph CG(*M);
+  /***
+   * Returns true if a function outside every recursive SCC has something for
+   * runOnFunction to do: a pointer chasing loop, or a node allocation in a loop
+  */
+  bool hasLoopCandidates(Function& F, FunctionAnalysisManager& FAM, std::vector<Function*>& self) {
+    LoopInfo& LI = FAM.getResult<LoopAnalysis>(F);
+    if (LI.empty()) {
+      return false;
+    }
+    if (LoopPrefetch && !getPointerChasingLoops(LI).empty()) {
+      return true;
+    }
+    return !getAllocationSites(F, self, LI, FAM.getResult<TargetLibraryAnalysis>(F)).empty();
+  }
 
-    std::unordered_map<Value*, std::vector<CallInst*>> argsToCalls = getArgumentsToCallsThatNeedIt(F, &CG);
+  /***
+   * Inserts prefetches into one function. scc is the recursive call graph SCC it
+   * belongs to, or just F when it is not recursive.
+  */
+  bool runOnFunction(Function &F, FunctionAnalysisManager &FAM, std::vector<Function*>& scc) {
+    std::unordered_map<Value*, std::vector<CallInst*>> argsToCalls = getArgumentsToCallsThatNeedIt(F, scc);
+    //the nodes we prefetch are visited by the recursive callees, so their accesses count too
+    computeFieldUsage(scc);
+    mergeSummaryFieldUsage(scc);
+    computeArrayBounds(scc);
+    prefetchLocality = 3;
+    if (PrefetchHints && isSinglePassTraversal(F, scc, FAM)) {
+      prefetchLocality = std::min(3u, (unsigned)StreamingLocality);
+    }
+    cacheLineSize = CacheLineSize;
+    if (cacheLineSize == 0) {
+      cacheLineSize = FAM.getResult<TargetIRAnalysis>(F).getCacheLineSize();
+    }
+    if (cacheLineSize == 0) {
+      cacheLineSize = 64;
+    }
     std::unordered_map<Value*, std::vector<PrefetchInfo>> RDSTypesToOffsets = getPrefetchInfoForArguments(F);
-
+    if (ProfileGuided && F.getEntryCount()) {
+      //never entered in the training run, nothing here is worth the bandwidth
+      if (F.getEntryCount()->getCount() == 0) {
+        argsToCalls.clear();
+      }
+      BlockFrequencyInfo& BFI = FAM.getResult<BlockFrequencyAnalysis>(F);
+      for (auto& [arg, calls] : argsToCalls) {
+        if (RDSTypesToOffsets.count(arg)) {
+          removeColdChildren(cast<Argument>(arg), calls, RDSTypesToOffsets[arg], BFI);
+        }
+      }
+    }
+    std::unordered_map<Value*, PrefetchPlan> plans;
+    for (auto& [arg, calls] : argsToCalls) {
+      if (!RDSTypesToOffsets.count(arg)) {
+        continue;
+      }
+      auto* argType = getArgumentStructType(cast<Argument>(arg));
+      plans[arg] = CostModel ? getCostModelPlan(F, calls, argType, FAM.getResult<TargetIRAnalysis>(F),
+                                                FAM.getResult<DominatorTreeAnalysis>(F))
+                             : getDefaultPlan();
+      if (SearchDescent) {
+        plans[arg].descent = getSearchDescentMembers(cast<Argument>(arg), argType, calls);
+      }
+      if (VisitOrder) {
+        if (auto first = getFirstVisitedChild(F, cast<Argument>(arg), calls)) {
+          plans[arg].firstVisited = *first;
+        }
+      }
+    }
+    //find the loops before the entry prefetches start splitting blocks
+    std::vector<PointerChase> chases;
+    if (LoopPrefetch) {
+      chases = getPointerChasingLoops(FAM.getResult<LoopAnalysis>(F));
+    }
+    if (ProfileGuided && F.getEntryCount()) {
+      if (F.getEntryCount()->getCount() == 0) {
+        chases.clear();
+      }
+      removeColdChases(chases, FAM.getResult<BlockFrequencyAnalysis>(F));
+    }
+    pipelinedArrays.clear();
+    std::vector<SiblingSite> siblings = getSiblingPrefetchSites(F, scc);
+    std::vector<AllocationSite> allocations = getAllocationSites(F, scc, FAM.getResult<LoopAnalysis>(F),
+                                                                 FAM.getResult<TargetLibraryAnalysis>(F));
+    bool changed = false;
 
 
     for (auto& [arg, calls] : argsToCalls) {
-      if (RDSTypesToOffsets.find(arg) == RDSTypesToOffsets.end()) {
+      if (RDSTypesToOffsets.find(arg) == RDSTypesToOffsets.end() || RDSTypesToOffsets[arg].empty() ||
+          plans[arg].depth == 0) {
         continue;
       }
-        genAndInsertPrefetchInstructions(arg, RDSTypesToOffsets[arg], F);
+        genAndInsertPrefetchInstructions(arg, getArgumentStructType(cast<Argument>(arg)), RDSTypesToOffsets[arg],
+                                         plans[arg], F);
+        changed = true;
 
     }
 
-    for (auto& bb : F){
-      for (auto& i : bb){
-        errs() << i << "\n";
-      }
+    for (auto& chase : chases) {
+      genAndInsertLoopPrefetchInstructions(chase, F);
+      changed = true;
+    }
+
+    for (auto& site : siblings) {
+      genAndInsertSiblingPrefetchInstructions(site, F);
+      changed = true;
+    }
+
+    for (auto& site : allocations) {
+      genAndInsertAllocationPrefetchInstructions(site, F);
+      changed = true;
+    }
+
+    return changed;
+  }
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    //the real work happens after the link, once the whole program is visible
+    if (LTOPhaseOpt == LTOPhase::PreLink) {
+      summaryPointeeTypes.clear();
+      buildTypeRecoveryIndex(M);
+      //the summary is new named metadata in the module
+      exportSummary(M);
+      return PreservedAnalyses::none();
     }
 
+    CallGraph& CG = MAM.getResult<CallGraphAnalysis>(M);
+    FunctionAnalysisManager& FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
 
-    return PreservedAnalyses::all();
+    summaries.clear();
+    if (LTOPhaseOpt == LTOPhase::PostLink) {
+      importSummaries(M);
+    }
+    std::vector<std::vector<Function*>> sccs =
+        summaries.empty() ? getRecursiveSCCs(CG) : getRecursiveSCCsWithSummaries(M, CG);
+    std::unordered_map<Function*, std::vector<Function*>> sccOf;
+    for (auto& scc : sccs) {
+      for (Function* fn : scc) {
+        sccOf[fn] = scc;
+      }
+    }
+
+    buildTypeRecoveryIndex(M);
+    compressedLinks.clear();
+    bool changed = false;
+    //before pool allocation and relayout, which size nodes by their type
+    if (SplitStructs && splitStructs(M, FAM, sccOf)) {
+      buildTypeRecoveryIndex(M);
+      changed = true;
+    }
+    if (ReorderFields && reorderStructs(M, FAM, sccOf)) {
+      buildTypeRecoveryIndex(M);
+      changed = true;
+    }
+    if (CompressPointers && compressPointers(M, FAM)) {
+      buildTypeRecoveryIndex(M);
+      changed = true;
+    }
+    changed |= PoolAllocation && poolAllocate(M, FAM);
+    changed |= Relayout && relayoutConstructedTrees(M, FAM, sccs);
+    changed |= HelperThread && runAheadTraversals(M, sccs);
+    changed |= Interleave && interleaveLookups(M, FAM);
+    for (Function& F : M) {
+      if (F.isDeclaration() || F.hasOptNone()) {
+        continue;
+      }
+      auto scc = sccOf.find(&F);
+      std::vector<Function*> self = {&F};
+      if (scc == sccOf.end() && !hasLoopCandidates(F, FAM, self)) {
+        continue;
+      }
+      if (runOnFunction(F, FAM, scc != sccOf.end() ? scc->second : self)) {
+        FAM.invalidate(F, PreservedAnalyses::none());
+        changed = true;
+      }
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
   }
 };
 }
@@ -304,15 +4567,24 @@ extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginIn
     LLVM_PLUGIN_API_VERSION, "GreedyPrefetch", "v0.1",
     [](PassBuilder &PB) {
       PB.registerPipelineParsingCallback(
-        [](StringRef Name, FunctionPassManager &FPM,
+        [](StringRef Name, ModulePassManager &MPM,
         ArrayRef<PassBuilder::PipelineElement>) {
           if (Name == "greedy-prefetch") {
-            FPM.addPass(GreedyPrefetchPass());
+            MPM.addPass(GreedyPrefetchPass());
             return true;
           }
           return false;
         }
       );
+      //late in the optimized pipeline, on mem2reg'd IR after inlining and loop
+      //transforms have settled, and before codegen schedules the prefetches
+      PB.registerOptimizerLastEPCallback(
+        [](ModulePassManager &MPM, OptimizationLevel Level) {
+          if (RunInDefaultPipeline && Level != OptimizationLevel::O0) {
+            MPM.addPass(GreedyPrefetchPass());
+          }
+        }
+      );
     }
   };
 }
@@ -6,14 +6,24 @@ PATH2LIB="./build/greedyPrefetchingPass/GreedyPrefetch.so"
 PASS=greedy-prefetch
 # Clean out any last profiler/pass/bytecode/output/ll files
 rm -f default.profraw *_prof *_greedy *.bc *.profdata *_output *.ll *.exe
-## Convert to bytecode
-clang -emit-llvm -c tests/$1.c -Xclang -disable-O0-optnone -o $1.bc
-## Output the regular executable, no passes done
-clang ${1}.bc -o ${1}.exe
-# When we run the profiler embedded executable, it generates a default.profraw file that contains the profile data.
-# ./${1}.exe > correct_output TODO: UPDATE EXAMPLES FOR OUTPUT REASONS
-opt -load-pass-plugin="./build/greedyPrefetchingPass/GreedyPrefetch.so" -passes="greedy-prefetch" ${1}.bc -o ${1}_greedy.bc
-clang ${1}_greedy.bc -o ${1}_greedy.exe
+# Optional second argument picks an optimization level, e.g. ./run.sh test O3
+OPT_LEVEL=${2:-O0}
+if [ "${OPT_LEVEL}" = "O0" ]; then
+  ## Convert to bytecode
+  clang -emit-llvm -c tests/$1.c -Xclang -disable-O0-optnone -o $1.bc
+  ## Output the regular executable, no passes done
+  clang ${1}.bc -o ${1}.exe
+  # When we run the profiler embedded executable, it generates a default.profraw file that contains the profile data.
+  # ./${1}.exe > correct_output TODO: UPDATE EXAMPLES FOR OUTPUT REASONS
+  opt -load-pass-plugin="${PATH2LIB}" -passes="${PASS}" ${1}.bc -o ${1}_greedy.bc
+  clang ${1}_greedy.bc -o ${1}_greedy.exe
+else
+  ## The plugin adds itself to the end of the optimized pipeline
+  clang -${OPT_LEVEL} -emit-llvm -c tests/$1.c -o $1.bc
+  clang -${OPT_LEVEL} tests/$1.c -o ${1}.exe
+  clang -${OPT_LEVEL} -emit-llvm -c -fpass-plugin="${PATH2LIB}" tests/$1.c -o ${1}_greedy.bc
+  clang -${OPT_LEVEL} -fpass-plugin="${PATH2LIB}" tests/$1.c -o ${1}_greedy.exe
+fi
 # get ll files for debugging
 llvm-dis ${1}.bc -o ${1}.ll
 llvm-dis ${1}_greedy.bc -o ${1}_greedy.ll
@@ -0,0 +1,87 @@
+#ifndef GREEDY_PREFETCH_RUNTIME_H
+#define GREEDY_PREFETCH_RUNTIME_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*** Runtime support for the transforms of the greedy prefetch pass. Programs
+ * built with -greedy-prefetch-pool-alloc, -greedy-prefetch-relayout,
+ * -greedy-prefetch-compress or -greedy-prefetch-helper-thread link against
+ * libGreedyPrefetchRuntime.a (and -pthread for the last).
+ * Calls to these functions are inserted by the pass, they are not meant to be
+ * called by hand. The pools and relayout are not thread safe, the helper
+ * thread is shared by all threads and serves one traversal at a time.
+ */
+
+/*** One pool per recursive struct type. Nodes are bump allocated out of large
+ * chunks so that they sit next to each other in construction order, freed nodes
+ * are reused before the chunk grows. The layout is mirrored by the pass:
+ * { i8*, i8*, i8*, i64, i8* }
+ */
+typedef struct GreedyPool {
+  char* cursor;       /* next free byte of the current chunk */
+  char* end;          /* end of the current chunk */
+  void* freeList;     /* freed nodes, linked through their first word */
+  size_t elementSize; /* node size rounded up to the malloc alignment */
+  char* base;         /* start of the region of a region pool, NULL otherwise */
+} GreedyPool;
+
+void* __greedy_pool_alloc(GreedyPool* pool, size_t size);
+void* __greedy_pool_calloc(GreedyPool* pool, size_t count, size_t size);
+/* replace free and realloc module wide, pointers not from a pool are passed on */
+void __greedy_pool_free(void* ptr);
+void* __greedy_pool_realloc(void* ptr, size_t size);
+
+/*** Region pools hold the nodes of types whose links the pass compressed to 32
+ * bits. All nodes live in one reserved range of address space, so a link is
+ * stored as its distance from base in GREEDY_REGION_GRANULE byte units, 0 being
+ * NULL. Running out of the region aborts, a node anywhere else couldn't be
+ * linked to.
+ */
+#define GREEDY_REGION_GRANULE 16
+void* __greedy_region_alloc(GreedyPool* pool, size_t size);
+void* __greedy_region_calloc(GreedyPool* pool, size_t count, size_t size);
+
+/*** Describes a node type to the relayout, emitted by the pass as a constant
+ * { i64, i64, i64, [n x i64] }
+ */
+typedef struct GreedyLayout {
+  size_t nodeSize;      /* bytes copied per node */
+  size_t clusterSize;   /* cache line size, a power of two */
+  size_t numLinks;      /* number of child pointers in a node */
+  size_t linkOffsets[]; /* byte offsets of the child pointers */
+} GreedyLayout;
+
+/* copies the tree under root into subtree clusters in a new chunk of pool,
+ * frees the old nodes and returns the new root (root itself if it can't) */
+void* __greedy_relayout(void* root, const GreedyLayout* layout, GreedyPool* pool);
+
+/*** Run-ahead helper thread. A traversal's address slice, generated by the pass,
+ * walks the same nodes as the traversal on another core so their lines are in
+ * the shared cache by the time the traversal gets there. The traversal counts
+ * the nodes it visits in __greedy_helper_visited, the slice counts the nodes it
+ * touches in __greedy_helper_touched and waits once it is more than its lead
+ * ahead. Only one traversal at a time has a helper.
+ */
+typedef bool (*GreedySlice)(void* node);
+
+/* the traversal counts visits in a thread local and adds them here 32 at a
+ * time with an atomic add, so a traversal running on another thread at the
+ * same time only makes the slice wait less */
+extern _Atomic size_t __greedy_helper_visited;
+/* written by the slice only */
+extern size_t __greedy_helper_touched;
+
+/* runs slice(root) on the helper thread, returns 0 if the helper is busy or
+ * can't be started */
+int __greedy_helper_start(GreedySlice slice, void* root);
+/* stops the slice started by __greedy_helper_start, which returned started.
+ * A slice the helper hasn't taken yet is dropped without waiting, a running one
+ * returns at its next wait */
+void __greedy_helper_stop(int started);
+/* called by the slice when it is more than lead nodes ahead, returns false once
+ * it has to stop */
+bool __greedy_helper_wait(size_t lead);
+
+#endif
@@ -0,0 +1,103 @@
+#include "greedyPrefetchRuntime.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+/*** The helper thread is started on first use and then waits for slices to run,
+ * so a traversal called over and over doesn't create a thread every time.
+ */
+
+/* on lines of their own, each is written by a different thread */
+_Alignas(64) _Atomic size_t __greedy_helper_visited;
+_Alignas(64) size_t __greedy_helper_touched;
+
+enum { SPINS_BEFORE_YIELD = 64 };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static int state;   /* 0 not started yet, 1 running, -1 couldn't be started */
+static int busy;    /* a traversal has the helper, until it stops it */
+static int running; /* the helper has taken the slice and not returned yet */
+static GreedySlice pendingSlice;
+static void* pendingRoot;
+static _Atomic bool stopping;
+
+static void* helperMain(void* unused) {
+  (void)unused;
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (!pendingSlice) {
+      pthread_cond_wait(&changed, &lock);
+    }
+    GreedySlice slice = pendingSlice;
+    void* root = pendingRoot;
+    pendingSlice = NULL;
+    running = 1;
+    pthread_mutex_unlock(&lock);
+    slice(root);
+    pthread_mutex_lock(&lock);
+    running = 0;
+    pthread_cond_broadcast(&changed);
+  }
+  return NULL;
+}
+
+int __greedy_helper_start(GreedySlice slice, void* root) {
+  pthread_mutex_lock(&lock);
+  if (state == 0) {
+    pthread_t helper;
+    state = pthread_create(&helper, NULL, helperMain, NULL) == 0 ? 1 : -1;
+    if (state == 1) {
+      pthread_detach(helper);
+    }
+  }
+  if (state < 0 || busy) {
+    pthread_mutex_unlock(&lock);
+    return 0;
+  }
+  busy = 1;
+  /* the helper is idle, nobody else writes these now */
+  atomic_store_explicit(&__greedy_helper_visited, 0, memory_order_relaxed);
+  atomic_store_explicit(&stopping, false, memory_order_relaxed);
+  __greedy_helper_touched = 0;
+  pendingSlice = slice;
+  pendingRoot = root;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+  return 1;
+}
+
+void __greedy_helper_stop(int started) {
+  if (!started) {
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  if (pendingSlice) {
+    /* the helper hasn't taken it yet, nothing to wait for */
+    pendingSlice = NULL;
+  } else {
+    /* a count of 0 puts the running slice ahead, so it waits and is told to return */
+    atomic_store_explicit(&stopping, true, memory_order_relaxed);
+    atomic_store_explicit(&__greedy_helper_visited, 0, memory_order_relaxed);
+    while (running) {
+      pthread_cond_wait(&changed, &lock);
+    }
+  }
+  busy = 0;
+  pthread_mutex_unlock(&lock);
+}
+
+bool __greedy_helper_wait(size_t lead) {
+  for (unsigned spins = 0;; ++spins) {
+    if (atomic_load_explicit(&stopping, memory_order_relaxed)) {
+      return false;
+    }
+    size_t visited = atomic_load_explicit(&__greedy_helper_visited, memory_order_relaxed);
+    if (__greedy_helper_touched <= visited + lead) {
+      return true;
+    }
+    if (spins >= SPINS_BEFORE_YIELD) {
+      sched_yield();
+    }
+  }
+}
@@ -0,0 +1,184 @@
+#include "greedyPrefetchRuntime.h"
+#include "poolChunks.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*** Pool allocation in the style of Lattner and Adve's automatic pool
+ * allocation, simplified to one pool per node type. Every chunk is recorded so
+ * that free and realloc can tell pool nodes from ordinary heap memory.
+ */
+
+enum { MIN_CHUNK_SIZE = 1 << 16, NODES_PER_CHUNK = 256 };
+
+/* every 32 bit index is addressable, pages are only backed once touched */
+static const size_t REGION_SIZE = (size_t)GREEDY_REGION_GRANULE << 32;
+
+typedef struct Chunk {
+  uintptr_t begin, end;
+  GreedyPool* pool;
+} Chunk;
+
+/* sorted by begin */
+static Chunk* chunks;
+static size_t numChunks, chunkCapacity;
+
+static Chunk* findChunk(const void* ptr) {
+  uintptr_t addr = (uintptr_t)ptr;
+  size_t lo = 0, hi = numChunks;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (addr < chunks[mid].begin) {
+      hi = mid;
+    } else if (addr >= chunks[mid].end) {
+      lo = mid + 1;
+    } else {
+      return &chunks[mid];
+    }
+  }
+  return NULL;
+}
+
+int greedyPoolRegisterChunk(GreedyPool* pool, char* memory, size_t size) {
+  if (numChunks == chunkCapacity) {
+    size_t capacity = chunkCapacity ? chunkCapacity * 2 : 16;
+    Chunk* grown = realloc(chunks, capacity * sizeof(Chunk));
+    if (!grown) {
+      return 0;
+    }
+    chunks = grown;
+    chunkCapacity = capacity;
+  }
+  size_t i = numChunks;
+  while (i > 0 && chunks[i - 1].begin > (uintptr_t)memory) {
+    chunks[i] = chunks[i - 1];
+    --i;
+  }
+  chunks[i] = (Chunk){(uintptr_t)memory, (uintptr_t)memory + size, pool};
+  ++numChunks;
+  return 1;
+}
+
+static int addChunk(GreedyPool* pool, size_t size) {
+  char* memory = malloc(size);
+  if (!memory) {
+    return 0;
+  }
+  if (!greedyPoolRegisterChunk(pool, memory, size)) {
+    free(memory);
+    return 0;
+  }
+  pool->cursor = memory;
+  pool->end = memory + size;
+  return 1;
+}
+
+void* __greedy_pool_alloc(GreedyPool* pool, size_t size) {
+  /* bigger requests, e.g. a node with a trailing array, stay on the heap */
+  if (size > pool->elementSize) {
+    return malloc(size);
+  }
+  if (pool->freeList) {
+    void* node = pool->freeList;
+    pool->freeList = *(void**)node;
+    return node;
+  }
+  if ((size_t)(pool->end - pool->cursor) < pool->elementSize) {
+    size_t chunkSize = pool->elementSize * NODES_PER_CHUNK;
+    if (chunkSize < MIN_CHUNK_SIZE) {
+      chunkSize = MIN_CHUNK_SIZE;
+    }
+    if (!addChunk(pool, chunkSize)) {
+      return malloc(size);
+    }
+  }
+  void* node = pool->cursor;
+  pool->cursor += pool->elementSize;
+  return node;
+}
+
+void* __greedy_pool_calloc(GreedyPool* pool, size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return NULL;
+  }
+  void* node = __greedy_pool_alloc(pool, count * size);
+  if (node) {
+    memset(node, 0, count * size);
+  }
+  return node;
+}
+
+void __greedy_pool_free(void* ptr) {
+  Chunk* chunk = ptr ? findChunk(ptr) : NULL;
+  if (!chunk) {
+    free(ptr);
+    return;
+  }
+  *(void**)ptr = chunk->pool->freeList;
+  chunk->pool->freeList = ptr;
+}
+
+void* __greedy_pool_realloc(void* ptr, size_t size) {
+  Chunk* chunk = ptr ? findChunk(ptr) : NULL;
+  if (!chunk) {
+    return realloc(ptr, size);
+  }
+  size_t elementSize = chunk->pool->elementSize;
+  if (size <= elementSize) {
+    return ptr;
+  }
+  void* moved = malloc(size);
+  if (!moved) {
+    return NULL;
+  }
+  memcpy(moved, ptr, elementSize);
+  __greedy_pool_free(ptr);
+  return moved;
+}
+
+/* reserves the region on first use. The first granule is never handed out so
+ * that no node has index 0 */
+static void reserveRegion(GreedyPool* pool) {
+  char* region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED || !greedyPoolRegisterChunk(pool, region, REGION_SIZE)) {
+    fputs("greedy prefetch runtime: can't reserve the region of a compressed pool\n", stderr);
+    abort();
+  }
+  pool->base = region;
+  pool->cursor = region + GREEDY_REGION_GRANULE;
+  pool->end = region + REGION_SIZE;
+}
+
+void* __greedy_region_alloc(GreedyPool* pool, size_t size) {
+  if (size > pool->elementSize) {
+    fputs("greedy prefetch runtime: node bigger than its compressed pool's elements\n", stderr);
+    abort();
+  }
+  if (!pool->base) {
+    reserveRegion(pool);
+  }
+  if (pool->freeList) {
+    void* node = pool->freeList;
+    pool->freeList = *(void**)node;
+    return node;
+  }
+  if ((size_t)(pool->end - pool->cursor) < pool->elementSize) {
+    fputs("greedy prefetch runtime: compressed pool out of indices\n", stderr);
+    abort();
+  }
+  void* node = pool->cursor;
+  pool->cursor += pool->elementSize;
+  return node;
+}
+
+void* __greedy_region_calloc(GreedyPool* pool, size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return NULL;
+  }
+  void* node = __greedy_region_alloc(pool, count * size);
+  memset(node, 0, count * size);
+  return node;
+}
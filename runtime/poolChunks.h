@@ -0,0 +1,12 @@
+#ifndef GREEDY_PREFETCH_POOL_CHUNKS_H
+#define GREEDY_PREFETCH_POOL_CHUNKS_H
+
+#include "greedyPrefetchRuntime.h"
+
+/*** Shared by the runtime sources, not called by the pass. Records memory the
+ * runtime allocated itself as belonging to pool, so that free and realloc of the
+ * nodes in it are handled by the pool. Returns 0 if out of memory.
+ */
+int greedyPoolRegisterChunk(GreedyPool* pool, char* memory, size_t size);
+
+#endif
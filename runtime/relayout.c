@@ -0,0 +1,215 @@
+#include "greedyPrefetchRuntime.h"
+#include "poolChunks.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*** Cache conscious relayout of a finished tree, after Chilimbi, Hill and
+ * Larus' ccmorph. The nodes are copied into one block in subtree clusters: a
+ * cluster holds as many nodes of a subtree as fit in a cache line, taken
+ * breadth first from its root, so a descent touches one line for several levels.
+ * Clusters are placed depth first and never straddle a line. Only trees are
+ * moved, a node reached twice means a shared node or a cycle and the structure
+ * is left where it is. Visited nodes are told apart by tagging the low bit of
+ * their first link, which is free as nodes are at least pointer aligned.
+ */
+
+/* the nodes of the tree being moved, numbered in depth first order */
+typedef struct Tree {
+  void** nodes;
+  size_t* children; /* numLinks per node, the number of each child or NO_CHILD */
+  size_t numNodes, capacity;
+  size_t numLinks;
+} Tree;
+
+#define NO_CHILD SIZE_MAX
+
+static int pushIndex(size_t** stack, size_t* size, size_t* capacity, size_t value) {
+  if (*size == *capacity) {
+    size_t grown = *capacity ? *capacity * 2 : 64;
+    size_t* resized = realloc(*stack, grown * sizeof(size_t));
+    if (!resized) {
+      return 0;
+    }
+    *stack = resized;
+    *capacity = grown;
+  }
+  (*stack)[(*size)++] = value;
+  return 1;
+}
+
+static void* getLink(void* node, const GreedyLayout* layout, size_t link) {
+  uintptr_t child;
+  memcpy(&child, (char*)node + layout->linkOffsets[link], sizeof(void*));
+  return (void*)(child & ~(uintptr_t)1);
+}
+
+static uintptr_t* getTag(void* node, const GreedyLayout* layout) {
+  return (uintptr_t*)((char*)node + layout->linkOffsets[0]);
+}
+
+static int inCluster(const size_t* cluster, size_t clusterSize, size_t index) {
+  for (size_t i = 0; i < clusterSize; ++i) {
+    if (cluster[i] == index) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* numbers and tags node, growing the tables as needed. Returns 0 if node is
+ * already tagged or out of memory */
+static int addNode(Tree* tree, void* node, const GreedyLayout* layout) {
+  if (tree->numNodes == tree->capacity) {
+    size_t grown = tree->capacity ? tree->capacity * 2 : 256;
+    void** nodes = realloc(tree->nodes, grown * sizeof(void*));
+    if (!nodes) {
+      return 0;
+    }
+    tree->nodes = nodes;
+    size_t* children = realloc(tree->children, grown * tree->numLinks * sizeof(size_t));
+    if (!children) {
+      return 0;
+    }
+    tree->children = children;
+    tree->capacity = grown;
+  }
+  uintptr_t* tag = getTag(node, layout);
+  if (*tag & 1) {
+    return 0;
+  }
+  *tag |= 1;
+  tree->nodes[tree->numNodes++] = node;
+  return 1;
+}
+
+void* __greedy_relayout(void* root, const GreedyLayout* layout, GreedyPool* pool) {
+  size_t stride = pool->elementSize;
+  size_t line = layout->clusterSize;
+  size_t numLinks = layout->numLinks;
+  if (!root || !numLinks || stride < layout->nodeSize || line < sizeof(void*) || (line & (line - 1))) {
+    return root;
+  }
+  void* result = root;
+  Tree tree = {NULL, NULL, 0, 0, numLinks};
+  size_t* stack = NULL;
+  size_t stackSize = 0, stackCapacity = 0;
+  size_t* cluster = NULL;
+  size_t* walk = NULL;
+  size_t* frontier = NULL;
+  size_t* offsets = NULL;
+  char* block = NULL;
+  if (!addNode(&tree, root, layout) || !pushIndex(&stack, &stackSize, &stackCapacity, 0)) {
+    goto done;
+  }
+
+  /* number the nodes and record the children by number. Every node is reached
+   * once through its parent, reaching one twice means a shared node or a cycle */
+  while (stackSize) {
+    size_t parent = stack[--stackSize];
+    void* node = tree.nodes[parent];
+    for (size_t link = numLinks; link-- > 0;) {
+      void* child = getLink(node, layout, link);
+      size_t index = tree.numNodes;
+      if (!child) {
+        index = NO_CHILD;
+      } else if (!addNode(&tree, child, layout) || !pushIndex(&stack, &stackSize, &stackCapacity, index)) {
+        goto done;
+      }
+      tree.children[parent * numLinks + link] = index;
+    }
+  }
+
+  /* cut the tree into clusters of perCluster nodes and give each node its offset */
+  size_t perCluster = line / stride ? line / stride : 1;
+  cluster = malloc(perCluster * sizeof(size_t));
+  walk = malloc((perCluster * numLinks + 1) * sizeof(size_t));
+  frontier = malloc(perCluster * numLinks * sizeof(size_t));
+  offsets = malloc(tree.numNodes * sizeof(size_t));
+  if (!cluster || !walk || !frontier || !offsets) {
+    goto done;
+  }
+  size_t offset = 0;
+  pushIndex(&stack, &stackSize, &stackCapacity, 0);
+  while (stackSize) {
+    size_t clusterSize = 0;
+    cluster[clusterSize++] = stack[--stackSize];
+    for (size_t i = 0; i < clusterSize && clusterSize < perCluster; ++i) {
+      const size_t* links = &tree.children[cluster[i] * numLinks];
+      for (size_t link = 0; link < numLinks && clusterSize < perCluster; ++link) {
+        if (links[link] != NO_CHILD) {
+          cluster[clusterSize++] = links[link];
+        }
+      }
+    }
+    /* the subtrees hanging off the cluster are placed in the order a depth first
+     * walk reaches them, so the next one goes on top of the stack */
+    size_t walkSize = 0, frontierSize = 0;
+    walk[walkSize++] = cluster[0];
+    while (walkSize) {
+      size_t index = walk[--walkSize];
+      if (!inCluster(cluster, clusterSize, index)) {
+        frontier[frontierSize++] = index;
+        continue;
+      }
+      for (size_t link = numLinks; link-- > 0;) {
+        if (tree.children[index * numLinks + link] != NO_CHILD) {
+          walk[walkSize++] = tree.children[index * numLinks + link];
+        }
+      }
+    }
+    while (frontierSize) {
+      if (!pushIndex(&stack, &stackSize, &stackCapacity, frontier[--frontierSize])) {
+        goto done;
+      }
+    }
+    size_t bytes = clusterSize * stride;
+    if (bytes <= line && offset % line + bytes > line) {
+      offset = (offset + line - 1) & ~(line - 1);
+    }
+    for (size_t i = 0; i < clusterSize; ++i) {
+      offsets[cluster[i]] = offset;
+      offset += stride;
+    }
+  }
+
+  size_t blockSize = (offset + line - 1) & ~(line - 1);
+  block = aligned_alloc(line, blockSize);
+  if (!block) {
+    goto done;
+  }
+  for (size_t i = 0; i < tree.numNodes; ++i) {
+    char* copy = block + offsets[i];
+    memcpy(copy, tree.nodes[i], layout->nodeSize);
+    for (size_t link = 0; link < numLinks; ++link) {
+      size_t child = tree.children[i * numLinks + link];
+      void* moved = child != NO_CHILD ? block + offsets[child] : NULL;
+      memcpy(copy + layout->linkOffsets[link], &moved, sizeof(void*));
+    }
+  }
+  /* the gaps left by line alignment are never handed out */
+  if (!greedyPoolRegisterChunk(pool, block, blockSize)) {
+    free(block);
+    goto done;
+  }
+  for (size_t i = 0; i < tree.numNodes; ++i) {
+    __greedy_pool_free(tree.nodes[i]);
+  }
+  result = block + offsets[0];
+
+done:
+  if (result == root) {
+    for (size_t i = 0; i < tree.numNodes; ++i) {
+      *getTag(tree.nodes[i], layout) &= ~(uintptr_t)1;
+    }
+  }
+  free(tree.nodes);
+  free(tree.children);
+  free(stack);
+  free(cluster);
+  free(walk);
+  free(frontier);
+  free(offsets);
+  return result;
+}
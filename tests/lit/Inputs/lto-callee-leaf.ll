@@ -0,0 +1,9 @@
+source_filename = "lto-callee.c"
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+; a later version of lto-callee.c, moved to another module path, in which
+; @sum_r no longer calls back into @sum
+define i32 @sum_r(%struct.Tree* %t) {
+  ret i32 0
+}
@@ -0,0 +1,10 @@
+source_filename = "lto-callee.c"
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+declare i32 @sum(%struct.Tree*)
+
+define i32 @sum_r(%struct.Tree* %t) {
+  %s = call i32 @sum(%struct.Tree* %t)
+  ret i32 %s
+}
@@ -0,0 +1,16 @@
+source_filename = "lto-static.c"
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+declare i32 @sum(%struct.Tree*)
+
+; a static of the same name as the external @sum_r, which it is not
+define internal i32 @sum_r(%struct.Tree* %t) {
+  %s = call i32 @sum(%struct.Tree* %t)
+  ret i32 %s
+}
+
+define i32 @entry(%struct.Tree* %t) {
+  %s = call i32 @sum_r(%struct.Tree* %t)
+  ret i32 %s
+}
@@ -0,0 +1,98 @@
+; Allocations of nodes inside loops prefetch the next allocation for writing,
+; one line per cache line of the requested size: count x size for calloc. The
+; last address of each site is kept per thread.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-alloc -greedy-prefetch-cache-line=64 -S %s | FileCheck %s
+
+; CHECK:       @__greedy_prefetch_alloc_last = internal thread_local global i8* null
+; CHECK-LABEL: define %struct.Node* @build_calloc(
+; CHECK:       %alloc.stride = select i1 {{%.*}}, i64 256, i64
+; CHECK:       call void @llvm.prefetch.p0i8(i8* %alloc.next, i32 1, i32 3, i32 1)
+; CHECK:       getelementptr i8, i8* %alloc.next, i64 64
+; CHECK:       getelementptr i8, i8* %alloc.next, i64 128
+; CHECK:       [[L:%.*]] = getelementptr i8, i8* %alloc.next, i64 192
+; CHECK-NEXT:  call void @llvm.prefetch.p0i8(i8* [[L]], i32 1, i32 3, i32 1)
+; CHECK-NOT:   @llvm.prefetch
+; CHECK-LABEL: define %struct.Node* @build_one(
+; CHECK:       %alloc.stride = select i1 {{%.*}}, i64 16, i64
+; CHECK:       call void @llvm.prefetch.p0i8(i8* %alloc.next, i32 1, i32 3, i32 1)
+; CHECK-NOT:   @llvm.prefetch
+; CHECK-LABEL: define %struct.Node* @build_malloc(
+; CHECK:       %alloc.stride = select i1 {{%.*}}, i64 128, i64
+; CHECK:       call void @llvm.prefetch.p0i8(i8* %alloc.next, i32 1, i32 3, i32 1)
+; CHECK:       [[M:%.*]] = getelementptr i8, i8* %alloc.next, i64 64
+; CHECK-NEXT:  call void @llvm.prefetch.p0i8(i8* [[M]], i32 1, i32 3, i32 1)
+; CHECK-NOT:   @llvm.prefetch
+; CHECK-LABEL: define %struct.Node* @single(
+; CHECK-NOT:   @llvm.prefetch
+; CHECK:       ret
+
+%struct.Node = type { i64, %struct.Node* }
+
+declare noalias i8* @malloc(i64)
+declare noalias i8* @calloc(i64, i64)
+
+; calloc(count, size): the allocation is 4 x 64 bytes, four lines
+define %struct.Node* @build_calloc(i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %inext, %loop ]
+  %head = phi %struct.Node* [ null, %entry ], [ %node, %loop ]
+  %mem = call i8* @calloc(i64 4, i64 64)
+  %node = bitcast i8* %mem to %struct.Node*
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 1
+  store %struct.Node* %head, %struct.Node** %naddr
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %loop, label %exit
+
+exit:
+  ret %struct.Node* %node
+}
+
+; calloc(1, 16) is one line although its first argument is smaller than a node
+define %struct.Node* @build_one(i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %inext, %loop ]
+  %head = phi %struct.Node* [ null, %entry ], [ %node, %loop ]
+  %mem = call i8* @calloc(i64 1, i64 16)
+  %node = bitcast i8* %mem to %struct.Node*
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 1
+  store %struct.Node* %head, %struct.Node** %naddr
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %loop, label %exit
+
+exit:
+  ret %struct.Node* %node
+}
+
+define %struct.Node* @build_malloc(i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %inext, %loop ]
+  %head = phi %struct.Node* [ null, %entry ], [ %node, %loop ]
+  %mem = call i8* @malloc(i64 128)
+  %node = bitcast i8* %mem to %struct.Node*
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 1
+  store %struct.Node* %head, %struct.Node** %naddr
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %loop, label %exit
+
+exit:
+  ret %struct.Node* %node
+}
+
+; allocations outside loops and recursion are left alone
+define %struct.Node* @single() {
+  %mem = call i8* @malloc(i64 16)
+  %node = bitcast i8* %mem to %struct.Node*
+  ret %struct.Node* %node
+}
@@ -0,0 +1,96 @@
+; Child arrays walked up to a count member are prefetched with a loop bounded by
+; the count, clamped to the array length and the prefetch cap.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-max-array-prefetches=2 -S %s | FileCheck %s --check-prefix=CAP
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-bounded-arrays=false -S %s | FileCheck %s --check-prefix=SLOTS
+
+; CHECK-LABEL: define i32 @nary(
+; CHECK:       %child.count = load i32, i32*
+; CHECK:       [[LEN:%.*]] = select i1 {{%.*}}, i64 {{%.*}}, i64 4
+; CHECK:       %child.bound = select i1 {{%.*}}, i64 [[LEN]], i64 16
+; CHECK:       prefetch-array:
+; CHECK-NEXT:  %child.index = phi i64
+; CHECK-NEXT:  [[SLOT:%.*]] = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 2, i64 %child.index
+; CHECK-NEXT:  %child = load %struct.Nary*, %struct.Nary** [[SLOT]]
+; CHECK-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Nary* %child, i32 0, i32 3, i32 1)
+; CHECK:       icmp ult i64 {{%.*}}, %child.bound
+
+; CHECK-LABEL: define i32 @heap(
+; CHECK:       %child.count = load i32, i32*
+; CHECK:       %child.array = load %struct.Heap**, %struct.Heap***
+; CHECK:       icmp ne %struct.Heap** %child.array, null
+; CHECK:       prefetch-array:
+; CHECK:       getelementptr inbounds %struct.Heap*, %struct.Heap** %child.array, i64 %child.index
+; CHECK:       call void @llvm.prefetch
+
+; CAP-LABEL:   define i32 @nary(
+; CAP:         %child.bound = select i1 {{%.*}}, i64 {{%.*}}, i64 2
+; CAP-LABEL:   define i32 @heap(
+; CAP:         %child.bound = select i1 {{%.*}}, i64 {{%.*}}, i64 2
+
+; Without the bound every slot of the fixed array is prefetched, and the
+; heap array, whose length is unknown, not at all.
+; SLOTS-LABEL: define i32 @nary(
+; SLOTS-NOT:   prefetch-array
+; SLOTS-COUNT-4: call void @llvm.prefetch
+; SLOTS-LABEL: define i32 @heap(
+; SLOTS-NOT:   call void @llvm.prefetch
+; SLOTS:       ret i32
+
+%struct.Nary = type { i32, i32, [4 x %struct.Nary*] }
+%struct.Heap = type { i32, i32, %struct.Heap** }
+
+define i32 @nary(%struct.Nary* %n) {
+entry:
+  %cntaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 1
+  %cnt = load i32, i32* %cntaddr
+  %vaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %any = icmp sgt i32 %cnt, 0
+  br i1 %any, label %loop, label %exit
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %loop ]
+  %acc = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  %idx = sext i32 %i to i64
+  %caddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 2, i64 %idx
+  %c = load %struct.Nary*, %struct.Nary** %caddr
+  %cs = call i32 @nary(%struct.Nary* %c)
+  %sum = add i32 %acc, %cs
+  %inext = add nsw i32 %i, 1
+  %more = icmp slt i32 %inext, %cnt
+  br i1 %more, label %loop, label %exit
+
+exit:
+  %res = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  ret i32 %res
+}
+
+; children in a heap array
+define i32 @heap(%struct.Heap* %n) {
+entry:
+  %cntaddr = getelementptr inbounds %struct.Heap, %struct.Heap* %n, i32 0, i32 1
+  %cnt = load i32, i32* %cntaddr
+  %vaddr = getelementptr inbounds %struct.Heap, %struct.Heap* %n, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %arraddr = getelementptr inbounds %struct.Heap, %struct.Heap* %n, i32 0, i32 2
+  %arr = load %struct.Heap**, %struct.Heap*** %arraddr
+  %any = icmp sgt i32 %cnt, 0
+  br i1 %any, label %loop, label %exit
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %loop ]
+  %acc = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  %idx = sext i32 %i to i64
+  %caddr = getelementptr inbounds %struct.Heap*, %struct.Heap** %arr, i64 %idx
+  %c = load %struct.Heap*, %struct.Heap** %caddr
+  %cs = call i32 @heap(%struct.Heap* %c)
+  %sum = add i32 %acc, %cs
+  %inext = add nsw i32 %i, 1
+  %more = icmp slt i32 %inext, %cnt
+  br i1 %more, label %loop, label %exit
+
+exit:
+  %res = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  ret i32 %res
+}
@@ -0,0 +1,53 @@
+; Prefetches go to the cache lines holding the members the traversal reads,
+; one per line.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-cache-line=64 -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-cache-line=256 -S %s | FileCheck %s --check-prefix=ONE
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-cache-line=64 -greedy-prefetch-max-lines=1 -S %s | FileCheck %s --check-prefix=ONE
+
+; Members 0 and 1 share the first line, member 3 is at byte 128.
+; CHECK-LABEL: define i64 @sum(
+; CHECK:       [[D:%.*]] = load %struct.Data*, %struct.Data**
+; CHECK-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Data* [[D]], i32 0, i32 3, i32 1)
+; CHECK-NEXT:  [[D8:%.*]] = bitcast %struct.Data* [[D]] to i8*
+; CHECK-NEXT:  [[L2:%.*]] = getelementptr i8, i8* [[D8]], i64 128
+; CHECK-NEXT:  call void @llvm.prefetch.p0i8(i8* [[L2]], i32 0, i32 3, i32 1)
+; CHECK-NEXT:  br label %entry.split
+
+; ONE-LABEL: define i64 @sum(
+; ONE:       [[D:%.*]] = load %struct.Data*, %struct.Data**
+; ONE-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Data* [[D]], i32 0, i32 3, i32 1)
+; ONE-NEXT:  br label %entry.split
+
+%struct.Data = type { i64, i64, [14 x i64], i64, [20 x i64], i64 }
+%struct.Tree = type { %struct.Tree*, %struct.Tree*, %struct.Data* }
+
+define i64 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %daddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %d = load %struct.Data*, %struct.Data** %daddr
+  %aaddr = getelementptr inbounds %struct.Data, %struct.Data* %d, i32 0, i32 0
+  %a = load i64, i64* %aaddr
+  %baddr = getelementptr inbounds %struct.Data, %struct.Data* %d, i32 0, i32 1
+  %b = load i64, i64* %baddr
+  %caddr = getelementptr inbounds %struct.Data, %struct.Data* %d, i32 0, i32 3
+  %c = load i64, i64* %caddr
+  %ab = add i64 %a, %b
+  %v = add i64 %ab, %c
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i64 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i64 @sum(%struct.Tree* %r)
+  %s = add i64 %ls, %rs
+  %s2 = add i64 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %s2, %body ]
+  ret i64 %res
+}
@@ -0,0 +1,75 @@
+; Compression stores links as 32 bit indices into a region pool for the type.
+; It uses the legality check of splitting, so functions taking or returning nodes
+; that other modules can call, or declarations with nodes in their signature,
+; keep the pointers.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-compress -S %s | FileCheck %s
+; RUN: sed 's/define internal i64 @sum/define i64 @sum/' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-compress -S | FileCheck %s --check-prefix=KEEP
+; RUN: sed 's/internal \(.*@make\)/\1/' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-compress -S | FileCheck %s --check-prefix=KEEP
+; RUN: sed 's/^;DECL //' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-compress -S | FileCheck %s --check-prefix=KEEP
+
+; CHECK:       %struct.T.compressed = type { i64, [4 x i64], i32, i32 }
+; CHECK:       @__greedy_pool.struct.T.compressed = internal global %struct.GreedyPool { i8* null, i8* null, i8* null, i64 48, i8* null }
+; CHECK-LABEL: define internal %struct.T* @make(
+; CHECK:       %mem = call i8* @__greedy_region_alloc(%struct.GreedyPool* @__greedy_pool.struct.T.compressed, i64 48)
+; CHECK:       %laddr = getelementptr inbounds %struct.T.compressed, %struct.T.compressed* {{%.*}}, i32 0, i32 2
+; CHECK:       store i32 %link.index{{.*}}, i32* %laddr
+; CHECK-LABEL: define internal i64 @sum(
+; CHECK:       %l.index = load i32, i32* %laddr
+; CHECK-NEXT:  [[OFFSET:%.*]] = zext i32 %l.index to i64
+; CHECK-NEXT:  [[BYTES:%.*]] = shl i64 [[OFFSET]], 4
+; CHECK-NEXT:  [[BASE:%.*]] = load i8*, i8** getelementptr inbounds (%struct.GreedyPool, %struct.GreedyPool* @__greedy_pool.struct.T.compressed, i32 0, i32 4)
+; CHECK-NEXT:  [[ADDR:%.*]] = getelementptr inbounds i8, i8* [[BASE]], i64 [[BYTES]]
+; CHECK-NEXT:  [[NODE:%.*]] = bitcast i8* [[ADDR]] to %struct.T*
+; CHECK-NEXT:  [[NULL:%.*]] = icmp eq i32 %l.index, 0
+; CHECK-NEXT:  %l = select i1 [[NULL]], %struct.T* null, %struct.T* [[NODE]]
+
+; KEEP-NOT:    %struct.T.compressed
+; KEEP-NOT:    @__greedy_region_alloc
+; KEEP:        call i8* @malloc(i64 56)
+
+%struct.T = type { i64, [4 x i64], %struct.T*, %struct.T* }
+
+declare noalias i8* @malloc(i64)
+;DECL declare void @dump(%struct.T*)
+
+define internal %struct.T* @make(i64 %k) {
+  %mem = call i8* @malloc(i64 56)
+  %t = bitcast i8* %mem to %struct.T*
+  %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+  store i64 %k, i64* %kaddr
+  %paddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 1, i64 0
+  store i64 %k, i64* %paddr
+  %laddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 2
+  store %struct.T* null, %struct.T** %laddr
+  %raddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 3
+  store %struct.T* null, %struct.T** %raddr
+  ret %struct.T* %t
+}
+
+define internal i64 @sum(%struct.T* %t) {
+entry:
+  %null = icmp eq %struct.T* %t, null
+  br i1 %null, label %done, label %node
+
+node:
+  %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+  %k = load i64, i64* %kaddr
+  %laddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 2
+  %l = load %struct.T*, %struct.T** %laddr
+  %raddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 3
+  %r = load %struct.T*, %struct.T** %raddr
+  %ls = call i64 @sum(%struct.T* %l)
+  %rs = call i64 @sum(%struct.T* %r)
+  %s = add i64 %ls, %rs
+  %res = add i64 %s, %k
+  ret i64 %res
+
+done:
+  ret i64 0
+}
+
+define i64 @main() {
+  %t = call %struct.T* @make(i64 1)
+  %s = call i64 @sum(%struct.T* %t)
+  ret i64 %s
+}
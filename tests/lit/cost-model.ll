@@ -0,0 +1,104 @@
+; The cost model picks the lookahead depth from the work per node and the
+; memory latency, switches to jump pointers past the deepest lookahead, and
+; skips prefetching when neither can hide the latency.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-cost-model -greedy-prefetch-memory-latency=1 -S %s | FileCheck %s --check-prefix=SHORT
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-cost-model -greedy-prefetch-memory-latency=20 -S %s | FileCheck %s --check-prefix=DEEP
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-cost-model -greedy-prefetch-memory-latency=100000 -S %s | FileCheck %s --check-prefix=LONG
+
+; SHORT-LABEL: define i32 @sum(
+; SHORT-COUNT-2: call void @llvm.prefetch
+; SHORT-NOT:   prefetch-child
+; SHORT-NOT:   jump-prefetch
+; SHORT-LABEL: define i32 @fa(
+; SHORT:       call void @llvm.prefetch.{{.*}}(%struct.B*
+
+; DEEP-LABEL:  define i32 @sum(
+; DEEP:        prefetch-child:
+; DEEP-NOT:    jump-prefetch
+; DEEP-LABEL:  define i32 @root(
+
+; LONG-LABEL:  define i32 @sum(
+; LONG:        jump-prefetch:
+; LONG-NOT:    prefetch-child
+; LONG-LABEL:  define i32 @fa(
+; LONG-NOT:    call void @llvm.prefetch
+; LONG-LABEL:  define i32 @fb(
+; LONG-NOT:    call void @llvm.prefetch
+; LONG:        ret i32
+
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+
+
+
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define i32 @root(%struct.Tree* %t) {
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %s = call i32 @sum(%struct.Tree* %l)
+  ret i32 %s
+}
+
+%struct.A = type { i32, %struct.B* }
+%struct.B = type { i32, %struct.A* }
+
+define i32 @fa(%struct.A* %a) {
+entry:
+  %isnull = icmp eq %struct.A* %a, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.A, %struct.A* %a, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %baddr = getelementptr inbounds %struct.A, %struct.A* %a, i32 0, i32 1
+  %b = load %struct.B*, %struct.B** %baddr
+  %s = call i32 @fb(%struct.B* %b)
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define i32 @fb(%struct.B* %b) {
+entry:
+  %isnull = icmp eq %struct.B* %b, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.B, %struct.B* %b, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %aaddr = getelementptr inbounds %struct.B, %struct.B* %b, i32 0, i32 1
+  %a = load %struct.A*, %struct.A** %aaddr
+  %s = call i32 @fa(%struct.A* %a)
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
@@ -0,0 +1,107 @@
+; The argument to recursive call dataflow follows stack slots and phis, and
+; ignores nodes that don't come from the argument.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @spilled(
+; CHECK:       conditional:
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+; CHECK:       call void @llvm.prefetch
+; CHECK:       getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+; CHECK:       call void @llvm.prefetch
+; CHECK-NEXT:  br label %entry.split
+
+; CHECK-LABEL: define i32 @diamonds(
+; CHECK:       conditional:
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+; CHECK:       call void @llvm.prefetch
+; CHECK-NEXT:  br label %entry.split
+
+; CHECK-LABEL: define i32 @unrelated(
+; CHECK-NOT:   call void @llvm.prefetch
+; CHECK:       ret i32
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+@other = global %struct.Tree* null
+
+; unoptimized code keeps the argument in a stack slot
+define i32 @spilled(%struct.Tree* %t) {
+entry:
+  %t.addr = alloca %struct.Tree*
+  store %struct.Tree* %t, %struct.Tree** %t.addr
+  %0 = load %struct.Tree*, %struct.Tree** %t.addr
+  %isnull = icmp eq %struct.Tree* %0, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %1 = load %struct.Tree*, %struct.Tree** %t.addr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %1, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @spilled(%struct.Tree* %l)
+  %2 = load %struct.Tree*, %struct.Tree** %t.addr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %2, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @spilled(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s, %body ]
+  ret i32 %res
+}
+
+; the child reaches the call through a chain of diamonds
+define i32 @diamonds(%struct.Tree* %t, i1 %c) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  br i1 %c, label %a1, label %b1
+a1:
+  br label %j1
+b1:
+  br label %j1
+j1:
+  %p1 = phi %struct.Tree* [ %l, %a1 ], [ %l, %b1 ]
+  br i1 %c, label %a2, label %b2
+a2:
+  br label %j2
+b2:
+  br label %j2
+j2:
+  %p2 = phi %struct.Tree* [ %p1, %a2 ], [ %p1, %b2 ]
+  br i1 %c, label %a3, label %b3
+a3:
+  br label %j3
+b3:
+  br label %j3
+j3:
+  %p3 = phi %struct.Tree* [ %p2, %a3 ], [ %p2, %b3 ]
+  %s = call i32 @diamonds(%struct.Tree* %p3, i1 %c)
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s, %j3 ]
+  ret i32 %res
+}
+
+; recurses on a node that doesn't come from its argument
+define i32 @unrelated(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %o = load %struct.Tree*, %struct.Tree** @other
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %o, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %s = call i32 @unrelated(%struct.Tree* %l)
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s, %body ]
+  ret i32 %res
+}
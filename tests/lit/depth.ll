@@ -0,0 +1,71 @@
+; Depth-k greedy prefetching of the children of a recursive argument.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=DEPTH1
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-depth=2 -S %s | FileCheck %s --check-prefix=DEPTH2
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-depth=2 -greedy-prefetch-max-per-arg=3 -S %s | FileCheck %s --check-prefix=BUDGET
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+; DEPTH1-LABEL: define i32 @sum(
+; DEPTH1:       %isNonNull = icmp ne %struct.Tree* %t, null
+; DEPTH1-NEXT:  br i1 %isNonNull, label %conditional, label %entry.split
+; DEPTH1:       conditional:
+; DEPTH1-NEXT:  [[LA:%.*]] = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+; DEPTH1-NEXT:  [[L:%.*]] = load %struct.Tree*, %struct.Tree** [[LA]]
+; DEPTH1-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Tree* [[L]], i32 0, i32 3, i32 1)
+; DEPTH1-NEXT:  [[RA:%.*]] = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+; DEPTH1-NEXT:  [[R:%.*]] = load %struct.Tree*, %struct.Tree** [[RA]]
+; DEPTH1-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Tree* [[R]], i32 0, i32 3, i32 1)
+; DEPTH1-NEXT:  br label %entry.split
+; DEPTH1-NOT:   call void @llvm.prefetch
+
+; DEPTH2-LABEL: define i32 @sum(
+; DEPTH2:       conditional:
+; DEPTH2-COUNT-2: call void @llvm.prefetch
+; DEPTH2:       icmp ne %struct.Tree* [[L:%.*]], null
+; DEPTH2:       prefetch-child:
+; DEPTH2-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* [[L]], i32 0, i32 1
+; DEPTH2-COUNT-2: call void @llvm.prefetch
+; DEPTH2:       prefetch-child3:
+; DEPTH2-COUNT-2: call void @llvm.prefetch
+; DEPTH2:       entry.split:
+; DEPTH2-NOT:   call void @llvm.prefetch
+; DEPTH2:       define i32 @root(
+
+; BUDGET-LABEL: define i32 @sum(
+; BUDGET-COUNT-3: call void @llvm.prefetch
+; BUDGET-NOT:   call void @llvm.prefetch
+; BUDGET:       entry.split:
+
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+; Not recursive, so there is no later visit to prefetch for.
+; DEPTH1-LABEL: define i32 @root(
+; DEPTH1-NOT:   call void @llvm.prefetch
+; DEPTH1:       ret i32
+define i32 @root(%struct.Tree* %t) {
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %s = call i32 @sum(%struct.Tree* %l)
+  ret i32 %s
+}
@@ -0,0 +1,90 @@
+; The helper thread runs an address slice of the traversal ahead of it. The slice
+; recurses on all links but the last, which it walks with a loop. The traversal
+; counts its visits in a thread local and adds every 32 to the count the helper
+; reads with an atomic add. A traversal that calls
+; something writing memory, here free, gets no helper.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-helper-thread -S %s | FileCheck %s
+
+; CHECK:       @__greedy_helper_pending.count = internal thread_local global i64 0
+; CHECK-LABEL: define internal i64 @count(
+; CHECK:       node:
+; CHECK-NEXT:  [[OLD:%.*]] = load i64, i64* @__greedy_helper_pending.count
+; CHECK-NEXT:  %helper.pending = add i64 [[OLD]], 1
+; CHECK-NEXT:  store i64 %helper.pending, i64* @__greedy_helper_pending.count
+; CHECK-NEXT:  [[REM:%.*]] = urem i64 %helper.pending, 32
+; CHECK-NEXT:  [[PUBLISH:%.*]] = icmp eq i64 [[REM]], 0
+; CHECK-NEXT:  br i1 [[PUBLISH]], label %helper.publish, label
+; CHECK:       helper.publish:
+; CHECK-NEXT:  atomicrmw add i64* @__greedy_helper_visited, i64 32 monotonic, align 8
+; CHECK-LABEL: define internal void @release(
+; CHECK-NOT:   @__greedy_helper_visited
+; CHECK-LABEL: define i64 @main(
+; CHECK:       %helper.started = call i32 @__greedy_helper_start(i1 (i8*)* @count.slice, i8* {{%.*}})
+; CHECK-NEXT:  %c = call i64 @count(%struct.Tree* %t)
+; CHECK-NEXT:  call void @__greedy_helper_stop(i32 %helper.started)
+; CHECK-NOT:   @__greedy_helper_start
+; CHECK:       ret i64 %c
+
+; CHECK-LABEL: define internal i1 @count.slice(i8* %0) {
+; CHECK:       visit:
+; CHECK-NEXT:  %node = phi i8* [ %0, %entry ], [ [[RIGHT:%.*]], %walk{{[0-9]+}} ]
+; CHECK:       walk:
+; CHECK:       getelementptr inbounds %struct.Tree, %struct.Tree* {{%.*}}, i32 0, i32 1
+; CHECK:       call i1 @count.slice(
+; CHECK:       walk{{[0-9]+}}:
+; CHECK:       getelementptr inbounds %struct.Tree, %struct.Tree* {{%.*}}, i32 0, i32 2
+; CHECK:       [[RIGHT]] = bitcast %struct.Tree* %child{{[0-9]*}} to i8*
+; CHECK-NEXT:  br label %visit
+; CHECK-NOT:   call i1 @count.slice(
+; CHECK:       }
+; CHECK-NOT:   @release.slice
+
+%struct.Tree = type { i64, %struct.Tree*, %struct.Tree* }
+
+declare void @free(i8*)
+
+define internal i64 @count(%struct.Tree* %t) {
+entry:
+  %null = icmp eq %struct.Tree* %t, null
+  br i1 %null, label %done, label %node
+
+node:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %lc = call i64 @count(%struct.Tree* %l)
+  %rc = call i64 @count(%struct.Tree* %r)
+  %c = add i64 %lc, %rc
+  %res = add i64 %c, 1
+  ret i64 %res
+
+done:
+  ret i64 0
+}
+
+define internal void @release(%struct.Tree* %t) {
+entry:
+  %null = icmp eq %struct.Tree* %t, null
+  br i1 %null, label %done, label %node
+
+node:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  call void @release(%struct.Tree* %l)
+  call void @release(%struct.Tree* %r)
+  %mem = bitcast %struct.Tree* %t to i8*
+  call void @free(i8* %mem)
+  ret void
+
+done:
+  ret void
+}
+
+define i64 @main(%struct.Tree* %t) {
+  %c = call i64 @count(%struct.Tree* %t)
+  call void @release(%struct.Tree* %t)
+  ret i64 %c
+}
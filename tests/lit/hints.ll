@@ -0,0 +1,192 @@
+; Prefetches keep locality 3 unless the traversal is shown to visit each node
+; once, and are writes when the traversal stores to the node.
+; RUN: %opt -passes=greedy-prefetch -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=NOHINTS
+
+; CHECK-LABEL: define internal i32 @once(
+; CHECK-COUNT-2: call void @llvm.prefetch.{{.*}}, i32 0, i32 0, i32 1)
+; CHECK-LABEL: define internal i32 @looped(
+; CHECK-COUNT-2: call void @llvm.prefetch.{{.*}}, i32 0, i32 3, i32 1)
+; CHECK-LABEL: define i32 @external(
+; CHECK-COUNT-2: call void @llvm.prefetch.{{.*}}, i32 0, i32 3, i32 1)
+; CHECK-LABEL: define internal i32 @nary(
+; CHECK:       call void @llvm.prefetch.{{.*}}, i32 0, i32 0, i32 1)
+; CHECK-LABEL: define internal void @graph(
+; CHECK-COUNT-2: call void @llvm.prefetch.{{.*}}, i32 0, i32 3, i32 1)
+; CHECK-LABEL: define internal void @bump(
+; CHECK-COUNT-2: call void @llvm.prefetch.{{.*}}, i32 1, i32 0, i32 1)
+
+; NOHINTS-LABEL: define internal i32 @once(
+; NOHINTS:     call void @llvm.prefetch.{{.*}}, i32 0, i32 3, i32 1)
+; NOHINTS-NOT: call void @llvm.prefetch.{{.*}}, i32 {{1, i32 [0-3]|0, i32 [0-2]}}, i32 1)
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+%struct.Nary = type { i32, i32, [4 x %struct.Nary*] }
+
+define internal i32 @once(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @once(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @once(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define internal i32 @looped(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @looped(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @looped(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define i32 @external(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @external(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @external(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+; an n-ary walk recursing from its child loop still visits each node once
+define internal i32 @nary(%struct.Nary* %n) {
+entry:
+  %cntaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 1
+  %cnt = load i32, i32* %cntaddr
+  %vaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %any = icmp sgt i32 %cnt, 0
+  br i1 %any, label %loop, label %exit
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %loop ]
+  %acc = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  %idx = sext i32 %i to i64
+  %caddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 2, i64 %idx
+  %c = load %struct.Nary*, %struct.Nary** %caddr
+  %cs = call i32 @nary(%struct.Nary* %c)
+  %sum = add i32 %acc, %cs
+  %inext = add nsw i32 %i, 1
+  %more = icmp slt i32 %inext, %cnt
+  br i1 %more, label %loop, label %exit
+
+exit:
+  %res = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  ret i32 %res
+}
+
+; a graph walk with a visited check meets nodes again
+define internal void @graph(%struct.Tree* %t, i32* %visited) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %idx = sext i32 %v to i64
+  %flagaddr = getelementptr inbounds i32, i32* %visited, i64 %idx
+  %flag = load i32, i32* %flagaddr
+  %seen = icmp ne i32 %flag, 0
+  br i1 %seen, label %exit, label %visit
+
+visit:
+  store i32 1, i32* %flagaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  call void @graph(%struct.Tree* %l, i32* %visited)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  call void @graph(%struct.Tree* %r, i32* %visited)
+  br label %exit
+
+exit:
+  ret void
+}
+
+; stores to the nodes it visits, so the children are prefetched for writing
+define internal void @bump(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %v1 = add i32 %v, 1
+  store i32 %v1, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  call void @bump(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  call void @bump(%struct.Tree* %r)
+  br label %exit
+
+exit:
+  ret void
+}
+
+define i32 @main(%struct.Tree* %t, %struct.Nary* %n, i32* %visited, i32 %k) {
+entry:
+  %a = call i32 @once(%struct.Tree* %t)
+  %b = call i32 @nary(%struct.Nary* %n)
+  call void @graph(%struct.Tree* %t, i32* %visited)
+  call void @bump(%struct.Tree* %t)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %loop ]
+  %c = call i32 @looped(%struct.Tree* %t)
+  %inext = add i32 %i, 1
+  %more = icmp slt i32 %inext, %k
+  br i1 %more, label %loop, label %exit
+
+exit:
+  %ab = add i32 %a, %b
+  ret i32 %ab
+}
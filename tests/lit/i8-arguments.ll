@@ -0,0 +1,77 @@
+; A node passed as i8* and cast to its struct in the body is cast back before
+; the prefetch GEPs. Without the cast typed pointer IR gets a GEP on %struct.Tree
+; through an i8*, which the verifier rejects when the output is read back.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-depth=2 -greedy-prefetch-visit-order -S %s | opt -S -passes=verify | FileCheck %s
+
+; CHECK-LABEL: define i32 @sum(i8* %p)
+; CHECK:       conditional:
+; CHECK-NEXT:  [[T:%.*]] = bitcast i8* %p to %struct.Tree*
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* [[T]], i32 0, i32 2
+; CHECK:       prefetch-continue:
+; CHECK-NEXT:  [[T2:%.*]] = bitcast i8* %p to %struct.Tree*
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* [[T2]], i32 0, i32 1
+
+; CHECK-LABEL: define i32 @nary(i8* %p)
+; CHECK:       conditional:
+; CHECK-NEXT:  [[N:%.*]] = bitcast i8* %p to %struct.Nary*
+; CHECK-NEXT:  getelementptr inbounds %struct.Nary, %struct.Nary* [[N]], i32 0, i32 1
+; CHECK:       prefetch-array:
+; CHECK:       [[N2:%.*]] = bitcast i8* %p to %struct.Nary*
+; CHECK-NEXT:  getelementptr inbounds %struct.Nary, %struct.Nary* [[N2]], i32 0, i32 2, i64 %child.index
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+%struct.Nary = type { i32, i32, [4 x %struct.Nary*] }
+
+define i32 @sum(i8* %p) {
+entry:
+  %isnull = icmp eq i8* %p, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %t = bitcast i8* %p to %struct.Tree*
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %l8 = bitcast %struct.Tree* %l to i8*
+  %ls = call i32 @sum(i8* %l8)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %r8 = bitcast %struct.Tree* %r to i8*
+  %rs = call i32 @sum(i8* %r8)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define i32 @nary(i8* %p) {
+entry:
+  %n = bitcast i8* %p to %struct.Nary*
+  %cntaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 1
+  %cnt = load i32, i32* %cntaddr
+  %vaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %any = icmp sgt i32 %cnt, 0
+  br i1 %any, label %loop, label %exit
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %loop ]
+  %acc = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  %idx = sext i32 %i to i64
+  %caddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 2, i64 %idx
+  %c = load %struct.Nary*, %struct.Nary** %caddr
+  %c8 = bitcast %struct.Nary* %c to i8*
+  %cs = call i32 @nary(i8* %c8)
+  %sum = add i32 %acc, %cs
+  %inext = add nsw i32 %i, 1
+  %more = icmp slt i32 %inext, %cnt
+  br i1 %more, label %loop, label %exit
+
+exit:
+  %res = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  ret i32 %res
+}
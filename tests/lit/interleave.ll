@@ -0,0 +1,135 @@
+; Interleaving keeps several lookups of upcoming iterations in flight. Each loop
+; is rewritten with analyses of the function as the previous rewrite left it, and
+; a loop that writes memory the lookup may read, here through @insert, keeps its
+; call.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-interleave -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-interleave -S %s | %opt -passes=verify -disable-output
+
+; CHECK-LABEL: define void @probe(
+; CHECK:       %lanes = alloca [8 x { %struct.Entry**, i64, %struct.Entry*, i1, i64 }]
+; CHECK-NOT:   call i64 @lookup(
+; CHECK:       interleave.step:
+; CHECK:       store i64 {{%.*}}, i64* %oaddr
+; CHECK-NOT:   call i64 @lookup(
+; CHECK-LABEL: define i64 @twice(
+; CHECK:       %lanes{{[0-9]+}} = alloca [8 x { %struct.Entry**, i64, %struct.Entry*, i1, i64 }]
+; CHECK:       %lanes = alloca [8 x { %struct.Entry**, i64, %struct.Entry*, i1, i64 }]
+; CHECK-NOT:   call i64 @lookup(
+; CHECK:       first:
+; CHECK:       interleave.step:
+; CHECK:       second:
+; CHECK:       interleave.step{{[0-9]+}}:
+; CHECK-NOT:   call i64 @lookup(
+; CHECK-LABEL: define void @upsert(
+; CHECK-NOT:   %lanes
+; CHECK:       %v = call i64 @lookup(%struct.Entry** %table, i64 %key)
+; CHECK-NEXT:  call void @insert(%struct.Entry** %table, i64 %key)
+
+%struct.Entry = type { i64, i64, %struct.Entry* }
+
+declare void @insert(%struct.Entry**, i64)
+
+define internal i64 @lookup(%struct.Entry** %table, i64 %key) #0 {
+entry:
+  %h = and i64 %key, 1023
+  %slot = getelementptr inbounds %struct.Entry*, %struct.Entry** %table, i64 %h
+  %first = load %struct.Entry*, %struct.Entry** %slot
+  br label %loop
+
+loop:
+  %e = phi %struct.Entry* [ %first, %entry ], [ %next, %miss ]
+  %null = icmp eq %struct.Entry* %e, null
+  br i1 %null, label %absent, label %check
+
+check:
+  %kaddr = getelementptr inbounds %struct.Entry, %struct.Entry* %e, i32 0, i32 0
+  %k = load i64, i64* %kaddr
+  %hit = icmp eq i64 %k, %key
+  br i1 %hit, label %found, label %miss
+
+miss:
+  %naddr = getelementptr inbounds %struct.Entry, %struct.Entry* %e, i32 0, i32 2
+  %next = load %struct.Entry*, %struct.Entry** %naddr
+  br label %loop
+
+found:
+  %vaddr = getelementptr inbounds %struct.Entry, %struct.Entry* %e, i32 0, i32 1
+  %v = load i64, i64* %vaddr
+  ret i64 %v
+
+absent:
+  ret i64 0
+}
+
+; the results go to memory the lookups can't read
+define void @probe(%struct.Entry** %table, i64* noalias %keys, i64* noalias %out, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %inext, %loop ]
+  %kaddr = getelementptr inbounds i64, i64* %keys, i64 %i
+  %key = load i64, i64* %kaddr
+  %v = call i64 @lookup(%struct.Entry** %table, i64 %key)
+  %oaddr = getelementptr inbounds i64, i64* %out, i64 %i
+  store i64 %v, i64* %oaddr
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+; two loops, each rewritten with analyses of the function as the first left it
+define i64 @twice(%struct.Entry** %table, i64* noalias %keys, i64 %n) {
+entry:
+  br label %first
+
+first:
+  %i = phi i64 [ 0, %entry ], [ %inext, %first ]
+  %sum = phi i64 [ 0, %entry ], [ %sumnext, %first ]
+  %kaddr = getelementptr inbounds i64, i64* %keys, i64 %i
+  %key = load i64, i64* %kaddr
+  %v = call i64 @lookup(%struct.Entry** %table, i64 %key)
+  %sumnext = add i64 %sum, %v
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %first, label %between
+
+between:
+  br label %second
+
+second:
+  %j = phi i64 [ 0, %between ], [ %jnext, %second ]
+  %total = phi i64 [ %sumnext, %between ], [ %totalnext, %second ]
+  %w = call i64 @lookup(%struct.Entry** %table, i64 %j)
+  %totalnext = add i64 %total, %w
+  %jnext = add i64 %j, 1
+  %again = icmp ult i64 %jnext, %n
+  br i1 %again, label %second, label %exit
+
+exit:
+  ret i64 %totalnext
+}
+
+; the insert may change the chains later lookups walk
+define void @upsert(%struct.Entry** %table, i64* noalias %keys, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %inext, %loop ]
+  %kaddr = getelementptr inbounds i64, i64* %keys, i64 %i
+  %key = load i64, i64* %kaddr
+  %v = call i64 @lookup(%struct.Entry** %table, i64 %key)
+  call void @insert(%struct.Entry** %table, i64 %key)
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+attributes #0 = { noinline readonly }
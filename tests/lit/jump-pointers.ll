@@ -0,0 +1,68 @@
+; Jump pointer prefetching keeps its table per traversal and per thread, and
+; clamps the table size.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-jump-pointers -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-jump-pointers -greedy-prefetch-jump-table-bits=64 -S %s | FileCheck %s --check-prefix=CLAMP
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=OFF
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+; CHECK-DAG: @__greedy_prefetch_jump_table.sum.8 = internal thread_local global [4096 x { i8*, i8* }] zeroinitializer
+; CHECK-DAG: @__greedy_prefetch_jump_history.sum.8 = internal thread_local global [8 x i8*] zeroinitializer
+; CHECK-DAG: @__greedy_prefetch_jump_cursor.sum.8 = internal thread_local global i32 0
+; CHECK-DAG: @__greedy_prefetch_jump_table.size.8 = internal thread_local global [4096 x { i8*, i8* }] zeroinitializer
+; CLAMP: @__greedy_prefetch_jump_table.sum.8 = internal thread_local global [1048576 x { i8*, i8* }]
+; OFF-NOT: @__greedy_prefetch_jump
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK:       %jp.entry = getelementptr inbounds [4096 x { i8*, i8* }], [4096 x { i8*, i8* }]* @__greedy_prefetch_jump_table.sum.8
+; CHECK:       %jp.key = load i8*
+; CHECK:       %jp.target = load i8*
+; CHECK:       jump-prefetch:
+; CHECK-NEXT:  call void @llvm.prefetch.p0i8(i8* %jp.target, i32 0, i32 3, i32 1)
+; CHECK:       jump-update:
+; CHECK:       getelementptr inbounds [4096 x { i8*, i8* }], [4096 x { i8*, i8* }]* @__greedy_prefetch_jump_table.sum.8
+; CHECK-LABEL: define i32 @size(
+; CHECK:       @__greedy_prefetch_jump_table.size.8
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define i32 @size(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @size(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @size(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, 1
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
@@ -0,0 +1,22 @@
+# lit configuration for the pass' IR tests, run by ctest or by hand with
+#   lit.py -sv --param plugin=<build>/greedyPrefetchingPass/GreedyPrefetch.so tests/lit
+import os
+
+import lit.formats
+
+config.name = 'GreedyPrefetch'
+config.test_format = lit.formats.ShTest(True)
+config.suffixes = ['.ll']
+config.excludes = ['Inputs']
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = lit_config.params.get('exec_root', config.test_source_root)
+
+plugin = lit_config.params.get('plugin')
+if not plugin:
+    lit_config.fatal('pass --param plugin=<path to GreedyPrefetch.so>')
+tools = lit_config.params.get('tools')
+if tools:
+    config.environment['PATH'] = os.pathsep.join([tools, config.environment.get('PATH', '')])
+
+# the plugin's options have to be registered before opt parses its command line
+config.substitutions.append(('%opt', 'opt -load {0} -load-pass-plugin={0}'.format(plugin)))
@@ -0,0 +1,55 @@
+; Pointer chasing loops get a chase ahead of the induction unless turned off.
+; The payload is read from a node prefetched an iteration earlier, so at
+; distance 1, where that node is the current one, there is no payload prefetch.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=D1
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-loop-distance=2 -S %s | FileCheck %s --check-prefix=D2
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-loops=false -S %s | FileCheck %s --check-prefix=OFF
+
+; D1-LABEL: define i64 @walk(
+; D1:       chase-next:
+; D1-NEXT:  [[A:%.*]] = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+; D1-NEXT:  [[N1:%.*]] = load %struct.Node*, %struct.Node** [[A]]
+; D1-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Node* [[N1]], i32 0, i32 3, i32 1)
+; D1-NEXT:  br label %loop.split
+
+; D2-LABEL: define i64 @walk(
+; D2:       chase-next:
+; D2-NEXT:  [[A:%.*]] = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+; D2-NEXT:  [[N1:%.*]] = load %struct.Node*, %struct.Node** [[A]]
+; D2:       chase-next1:
+; D2-NEXT:  [[B:%.*]] = getelementptr inbounds %struct.Node, %struct.Node* [[N1]], i32 0, i32 1
+; D2-NEXT:  [[N2:%.*]] = load %struct.Node*, %struct.Node** [[B]]
+; D2-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Node* [[N2]], i32 0, i32 3, i32 1)
+; D2-NEXT:  [[R:%.*]] = getelementptr inbounds %struct.Node, %struct.Node* [[N1]], i32 0, i32 0
+; D2-NEXT:  [[REC:%.*]] = load %struct.Rec*, %struct.Rec** [[R]]
+; D2-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Rec* [[REC]], i32 0, i32 3, i32 1)
+; D2-NEXT:  br label %loop.split
+
+; OFF-NOT: chase-next
+; OFF-NOT: call void @llvm.prefetch
+
+%struct.Rec = type { i64, i64 }
+%struct.Node = type { %struct.Rec*, %struct.Node* }
+
+define i64 @walk(%struct.Node* %head) {
+entry:
+  %isnull = icmp eq %struct.Node* %head, null
+  br i1 %isnull, label %exit, label %loop
+
+loop:
+  %p = phi %struct.Node* [ %head, %entry ], [ %next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  %recaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 0
+  %rec = load %struct.Rec*, %struct.Rec** %recaddr
+  %vaddr = getelementptr inbounds %struct.Rec, %struct.Rec* %rec, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  %sum = add i64 %acc, %v
+  %nextaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+  %next = load %struct.Node*, %struct.Node** %nextaddr
+  %done = icmp eq %struct.Node* %next, null
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  ret i64 %res
+}
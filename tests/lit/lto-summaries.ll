@@ -0,0 +1,62 @@
+; ThinLTO summaries: recursion through another module is found from its
+; summary, a same named static of another module doesn't count as the callee,
+; and a stale summary in the directory loses to a newer one.
+; RUN: rm -rf %t && mkdir -p %t/gp %t/static %t/stale
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-lto=pre-link -greedy-prefetch-summary-dir=%t/gp %S/Inputs/lto-callee.ll -o /dev/null
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-lto=pre-link -greedy-prefetch-summary-dir=%t/gp %s -o /dev/null
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-lto=post-link -greedy-prefetch-summary-dir=%t/gp -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=NONE
+
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-lto=pre-link -greedy-prefetch-summary-dir=%t/static %S/Inputs/lto-static.ll -o /dev/null
+; RUN: llvm-dis %t/static/*.summary.bc -o - | FileCheck %s --check-prefix=KEYS
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-lto=post-link -greedy-prefetch-summary-dir=%t/static -S %s | FileCheck %s --check-prefix=NONE
+
+; RUN: cp %t/gp/*.summary.bc %t/stale
+; RUN: touch -d '2000-01-01' %t/stale/*.summary.bc
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-lto=pre-link -greedy-prefetch-summary-dir=%t/stale %S/Inputs/lto-callee-leaf.ll -o /dev/null
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-lto=post-link -greedy-prefetch-summary-dir=%t/stale -S %s | FileCheck %s --check-prefix=NONE
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK:       conditional:
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+; CHECK-NEXT:  [[L:%.*]] = load %struct.Tree*
+; CHECK-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Tree* [[L]], i32 0, i32 3, i32 1)
+
+; NONE-NOT:    call void @llvm.prefetch
+
+; KEYS-DAG:    !{!"lto-static.c:sum_r", ![[CALLEES:[0-9]+]]}
+; KEYS-DAG:    ![[CALLEES]] = !{!"sum"}
+; KEYS-DAG:    !{!"entry", ![[ENTRY:[0-9]+]]}
+; KEYS-DAG:    ![[ENTRY]] = !{!"lto-static.c:sum_r"}
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+declare i32 @sum_r(%struct.Tree*)
+
+; recursive only through @sum_r in another module, the children's type is
+; recovered from the first child's value being read here
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %lvaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %l, i32 0, i32 0
+  %lv = load i32, i32* %lvaddr
+  %ls = call i32 @sum_r(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum_r(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s1 = add i32 %s, %lv
+  %s2 = add i32 %s1, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
@@ -0,0 +1,71 @@
+; Functions outside every recursive SCC are only transformed for their loops:
+; pointer chases and node allocations.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-loops -greedy-prefetch-alloc -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-loops=false -S %s | FileCheck %s --check-prefix=OFF
+
+; CHECK-LABEL: define %struct.Node* @build(
+; CHECK:       call void @llvm.prefetch.p0i8(i8* %alloc.next, i32 1, i32 3, i32 1)
+; CHECK-LABEL: define i64 @walk(
+; CHECK:       chase-next:
+; CHECK:       call void @llvm.prefetch
+; CHECK-LABEL: define i64 @second(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:  getelementptr
+; CHECK-NOT:   call void @llvm.prefetch
+
+; OFF-NOT:     call void @llvm.prefetch
+
+%struct.Node = type { i64, %struct.Node* }
+
+declare noalias i8* @malloc(i64)
+
+define %struct.Node* @build(i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %inext, %loop ]
+  %head = phi %struct.Node* [ null, %entry ], [ %node, %loop ]
+  %mem = call i8* @malloc(i64 16)
+  %node = bitcast i8* %mem to %struct.Node*
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 0
+  store i64 %i, i64* %vaddr
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 1
+  store %struct.Node* %head, %struct.Node** %naddr
+  %inext = add i64 %i, 1
+  %more = icmp ult i64 %inext, %n
+  br i1 %more, label %loop, label %exit
+
+exit:
+  ret %struct.Node* %node
+}
+
+define i64 @walk(%struct.Node* %head) {
+entry:
+  %isnull = icmp eq %struct.Node* %head, null
+  br i1 %isnull, label %exit, label %loop
+
+loop:
+  %p = phi %struct.Node* [ %head, %entry ], [ %next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  %sum = add i64 %acc, %v
+  %nextaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+  %next = load %struct.Node*, %struct.Node** %nextaddr
+  %done = icmp eq %struct.Node* %next, null
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  ret i64 %res
+}
+
+define i64 @second(%struct.Node* %head) {
+entry:
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %head, i32 0, i32 1
+  %n = load %struct.Node*, %struct.Node** %naddr
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %n, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  ret i64 %v
+}
@@ -0,0 +1,47 @@
+; Loading the plugin adds the pass to the end of the optimized pipelines.
+; RUN: %opt -passes='default<O2>' -S %s | FileCheck %s
+; RUN: %opt -passes='default<O1>' -S %s | FileCheck %s
+; RUN: %opt -passes='default<O0>' -S %s | FileCheck %s --check-prefix=OFF
+; RUN: %opt -passes='default<O2>' -greedy-prefetch-default-pipeline=false -S %s | FileCheck %s --check-prefix=OFF
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK:       conditional:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       entry.split:
+
+; OFF-NOT:     @llvm.prefetch
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+
+
+
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+define i32 @root(%struct.Tree* %t) {
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %s = call i32 @sum(%struct.Tree* %l)
+  ret i32 %s
+}
@@ -0,0 +1,84 @@
+; Pool allocation routes single node malloc and calloc calls of recursive structs
+; to a pool per type and every free through the runtime. Arrays of nodes stay on
+; the heap, and nothing changes when free may be called through a pointer.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-pool-alloc -S %s | FileCheck %s
+; RUN: sed 's/^;ESCAPE //' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-pool-alloc -S | FileCheck %s --check-prefix=ESCAPE
+
+; CHECK:       @__greedy_pool.struct.Node = internal global %struct.GreedyPool { i8* null, i8* null, i8* null, i64 16, i8* null }
+; CHECK-LABEL: define %struct.Node* @node(
+; CHECK:       %mem = call i8* @__greedy_pool_alloc(%struct.GreedyPool* @__greedy_pool.struct.Node, i64 16)
+; CHECK-LABEL: define %struct.Node* @zeroed(
+; CHECK:       %mem = call i8* @__greedy_pool_calloc(%struct.GreedyPool* @__greedy_pool.struct.Node, i64 1, i64 16)
+; CHECK-LABEL: define %struct.Node* @array(
+; CHECK:       %mem = call i8* @calloc(i64 8, i64 16)
+; CHECK-LABEL: define void @release(
+; CHECK:       call void @__greedy_pool_free(i8* %mem)
+
+; ESCAPE-NOT:  @__greedy_pool
+; ESCAPE-LABEL: define %struct.Node* @node(
+; ESCAPE:      call i8* @malloc(i64 16)
+; ESCAPE-LABEL: define %struct.Node* @zeroed(
+; ESCAPE:      call i8* @calloc(i64 1, i64 16)
+; ESCAPE-LABEL: define void @release(
+; ESCAPE:      call void @free(i8* %mem)
+
+%struct.Node = type { i64, %struct.Node* }
+
+@saved = global void (i8*)* null
+
+declare noalias i8* @malloc(i64)
+declare noalias i8* @calloc(i64, i64)
+declare void @free(i8*)
+
+define %struct.Node* @node(%struct.Node* %next) {
+  %mem = call i8* @malloc(i64 16)
+  %node = bitcast i8* %mem to %struct.Node*
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 1
+  store %struct.Node* %next, %struct.Node** %naddr
+  ret %struct.Node* %node
+}
+
+define %struct.Node* @zeroed() {
+  %mem = call i8* @calloc(i64 1, i64 16)
+  %node = bitcast i8* %mem to %struct.Node*
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %node, i32 0, i32 0
+  store i64 1, i64* %vaddr
+  ret %struct.Node* %node
+}
+
+; an array of nodes stays on the heap
+define %struct.Node* @array() {
+  %mem = call i8* @calloc(i64 8, i64 16)
+  %nodes = bitcast i8* %mem to %struct.Node*
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %nodes, i32 0, i32 0
+  store i64 1, i64* %vaddr
+  ret %struct.Node* %nodes
+}
+
+; free stored as a function pointer could get a pool node
+;ESCAPE define void @escape() {
+;ESCAPE   store void (i8*)* @free, void (i8*)** @saved
+;ESCAPE   ret void
+;ESCAPE }
+
+define void @release(%struct.Node* %n) {
+  %mem = bitcast %struct.Node* %n to i8*
+  call void @free(i8* %mem)
+  ret void
+}
+
+define i64 @length(%struct.Node* %n) {
+entry:
+  %null = icmp eq %struct.Node* %n, null
+  br i1 %null, label %done, label %next
+
+next:
+  %naddr = getelementptr inbounds %struct.Node, %struct.Node* %n, i32 0, i32 1
+  %m = load %struct.Node*, %struct.Node** %naddr
+  %rest = call i64 @length(%struct.Node* %m)
+  %len = add i64 %rest, 1
+  ret i64 %len
+
+done:
+  ret i64 0
+}
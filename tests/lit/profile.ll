@@ -0,0 +1,153 @@
+; With a profile, children behind cold recursive calls, cold pointer chasing
+; loops and functions never entered are not prefetched.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-pgo -greedy-prefetch-loops -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-loops -S %s | FileCheck %s --check-prefix=NOPGO
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK:       [[LA:%.*]] = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+; CHECK-NEXT:  [[L:%.*]] = load %struct.Tree*, %struct.Tree** [[LA]]
+; CHECK-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Tree* [[L]],
+; CHECK-NOT:   call void @llvm.prefetch
+; CHECK-LABEL: define i32 @never(
+; CHECK-NOT:   call void @llvm.prefetch
+; CHECK-LABEL: define i64 @walk(
+; CHECK:       chase-next:
+; CHECK:       call void @llvm.prefetch
+; CHECK-LABEL: define i64 @walk_never(
+; CHECK-NOT:   call void @llvm.prefetch
+; CHECK-LABEL: define i64 @walk_rare(
+; CHECK-NOT:   call void @llvm.prefetch
+; CHECK:       ret i64
+
+; NOPGO-LABEL: define i32 @sum(
+; NOPGO-COUNT-2: call void @llvm.prefetch
+; NOPGO-LABEL: define i32 @never(
+; NOPGO:       call void @llvm.prefetch
+; NOPGO-LABEL: define i64 @walk_never(
+; NOPGO:       chase-next:
+; NOPGO-LABEL: define i64 @walk_rare(
+; NOPGO:       chase-next:
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+%struct.Node = type { i64, %struct.Node* }
+
+define i32 @sum(%struct.Tree* %t) !prof !0 {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body, !prof !2
+
+body:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %rare = icmp eq i32 %v, 0
+  br i1 %rare, label %right, label %join, !prof !3
+
+right:
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  br label %join
+
+join:
+  %rv = phi i32 [ 0, %body ], [ %rs, %right ]
+  %s = add i32 %ls, %rv
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s, %join ]
+  ret i32 %res
+}
+
+define i32 @never(%struct.Tree* %t) !prof !1 {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @never(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @never(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s, %body ]
+  ret i32 %res
+}
+
+define i64 @walk(%struct.Node* %head) !prof !0 {
+entry:
+  %isnull = icmp eq %struct.Node* %head, null
+  br i1 %isnull, label %exit, label %loop, !prof !2
+
+loop:
+  %p = phi %struct.Node* [ %head, %entry ], [ %next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  %sum = add i64 %acc, %v
+  %nextaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+  %next = load %struct.Node*, %struct.Node** %nextaddr
+  %done = icmp eq %struct.Node* %next, null
+  br i1 %done, label %exit, label %loop, !prof !4
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  ret i64 %res
+}
+
+define i64 @walk_never(%struct.Node* %head) !prof !1 {
+entry:
+  %isnull = icmp eq %struct.Node* %head, null
+  br i1 %isnull, label %exit, label %loop
+
+loop:
+  %p = phi %struct.Node* [ %head, %entry ], [ %next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  %sum = add i64 %acc, %v
+  %nextaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+  %next = load %struct.Node*, %struct.Node** %nextaddr
+  %done = icmp eq %struct.Node* %next, null
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  ret i64 %res
+}
+
+define i64 @walk_rare(%struct.Node* %head) !prof !0 {
+entry:
+  %isnull = icmp eq %struct.Node* %head, null
+  br i1 %isnull, label %exit, label %loop, !prof !5
+
+loop:
+  %p = phi %struct.Node* [ %head, %entry ], [ %next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  %vaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  %sum = add i64 %acc, %v
+  %nextaddr = getelementptr inbounds %struct.Node, %struct.Node* %p, i32 0, i32 1
+  %next = load %struct.Node*, %struct.Node** %nextaddr
+  %done = icmp eq %struct.Node* %next, null
+  br i1 %done, label %exit, label %loop, !prof !6
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %sum, %loop ]
+  ret i64 %res
+}
+
+!0 = !{!"function_entry_count", i64 1000}
+!1 = !{!"function_entry_count", i64 0}
+!2 = !{!"branch_weights", i32 1, i32 1000}
+!3 = !{!"branch_weights", i32 1, i32 10000}
+!4 = !{!"branch_weights", i32 1, i32 100}
+!5 = !{!"branch_weights", i32 10000, i32 1}
+!6 = !{!"branch_weights", i32 1, i32 1}
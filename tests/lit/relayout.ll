@@ -0,0 +1,100 @@
+; Relayout copies the tree a recursive constructor returns into cache line sized
+; clusters. Constructors that take nodes, or whose nodes escape other than
+; through the returned root, are left alone.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-relayout -greedy-prefetch-cache-line=64 -S %s | FileCheck %s
+; RUN: sed 's/^;KEEP//' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-relayout -greedy-prefetch-cache-line=64 -S | FileCheck %s --check-prefix=KEEP
+
+; CHECK:       @__greedy_layout.struct.Tree.64 = internal constant { i64, i64, i64, [2 x i64] } { i64 24, i64 64, i64 2, [2 x i64] [i64 8, i64 16] }
+; CHECK-LABEL: define internal %struct.Tree* @build(
+; CHECK-NOT:   @__greedy_relayout
+; CHECK-LABEL: define internal %struct.Tree* @graft(
+; CHECK-NOT:   @__greedy_relayout
+; CHECK-LABEL: define i64 @main(
+; CHECK:       %t = call %struct.Tree* @build(i32 10)
+; CHECK-NEXT:  [[ROOT:%.*]] = bitcast %struct.Tree* %t to i8*
+; CHECK-NEXT:  [[MOVED:%.*]] = call i8* @__greedy_relayout(i8* [[ROOT]], i8* bitcast ({{.*}}@__greedy_layout.struct.Tree.64 to i8*), %struct.GreedyPool* @__greedy_pool.struct.Tree)
+; CHECK-NEXT:  [[TREE:%.*]] = bitcast i8* [[MOVED]] to %struct.Tree*
+; CHECK-NEXT:  %g = call %struct.Tree* @graft(%struct.Tree* [[TREE]], i32 3)
+; CHECK-NOT:   @__greedy_relayout(
+; CHECK:       ret i64
+
+; KEEP-NOT:    @__greedy_relayout
+
+%struct.Tree = type { i64, %struct.Tree*, %struct.Tree* }
+
+@kept = global %struct.Tree* null
+
+declare noalias i8* @malloc(i64)
+declare void @free(i8*)
+
+define internal %struct.Tree* @build(i32 %depth) {
+entry:
+  %leaf = icmp eq i32 %depth, 0
+  br i1 %leaf, label %done, label %node
+
+node:
+  %mem = call i8* @malloc(i64 24)
+  %t = bitcast i8* %mem to %struct.Tree*
+  %d = sub i32 %depth, 1
+  %l = call %struct.Tree* @build(i32 %d)
+  %r = call %struct.Tree* @build(i32 %d)
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  store %struct.Tree* %l, %struct.Tree** %laddr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  store %struct.Tree* %r, %struct.Tree** %raddr
+;KEEP  store %struct.Tree* %t, %struct.Tree** @kept
+  ret %struct.Tree* %t
+
+done:
+  ret %struct.Tree* null
+}
+
+; takes nodes built elsewhere, which may still be reachable from the caller
+define internal %struct.Tree* @graft(%struct.Tree* %old, i32 %depth) {
+entry:
+  %leaf = icmp eq i32 %depth, 0
+  br i1 %leaf, label %done, label %node
+
+node:
+  %mem = call i8* @malloc(i64 24)
+  %t = bitcast i8* %mem to %struct.Tree*
+  %d = sub i32 %depth, 1
+  %l = call %struct.Tree* @graft(%struct.Tree* %old, i32 %d)
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  store %struct.Tree* %l, %struct.Tree** %laddr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  store %struct.Tree* %old, %struct.Tree** %raddr
+  ret %struct.Tree* %t
+
+done:
+  ret %struct.Tree* %old
+}
+
+define i64 @sum(%struct.Tree* %t) {
+entry:
+  %null = icmp eq %struct.Tree* %t, null
+  br i1 %null, label %done, label %node
+
+node:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i64, i64* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %ls = call i64 @sum(%struct.Tree* %l)
+  %rs = call i64 @sum(%struct.Tree* %r)
+  %s = add i64 %ls, %rs
+  %res = add i64 %s, %v
+  ret i64 %res
+
+done:
+  ret i64 0
+}
+
+define i64 @main() {
+  %t = call %struct.Tree* @build(i32 10)
+  %g = call %struct.Tree* @graft(%struct.Tree* %t, i32 3)
+  %s = call i64 @sum(%struct.Tree* %g)
+  ret i64 %s
+}
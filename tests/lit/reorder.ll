@@ -0,0 +1,70 @@
+; Reordering moves the links and hot members of a node to its first cache line.
+; It uses the legality check of splitting, so functions taking or returning nodes
+; that other modules can call, or declarations with nodes in their signature,
+; keep the layout. So does a node whose hot members already share a line.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-reorder -greedy-prefetch-cache-line=64 -S %s | FileCheck %s
+; RUN: sed 's/define internal i64 @sum/define i64 @sum/' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-reorder -greedy-prefetch-cache-line=64 -S | FileCheck %s --check-prefix=KEEP
+; RUN: sed 's/internal \(.*@make\)/\1/' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-reorder -greedy-prefetch-cache-line=64 -S | FileCheck %s --check-prefix=KEEP
+; RUN: sed 's/^;DECL //' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-reorder -greedy-prefetch-cache-line=64 -S | FileCheck %s --check-prefix=KEEP
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-reorder -greedy-prefetch-cache-line=256 -S %s | FileCheck %s --check-prefix=KEEP
+
+; CHECK:       %struct.T.reordered = type { %struct.T*, %struct.T*, i64, [16 x i64] }
+; CHECK-LABEL: define internal %struct.T* @make(
+; CHECK:       %mem = call i8* @malloc(i64 152)
+; CHECK:       %kaddr = getelementptr inbounds %struct.T.reordered, %struct.T.reordered* {{%.*}}, i32 0, i32 2
+; CHECK:       %paddr = getelementptr inbounds %struct.T.reordered, %struct.T.reordered* {{%.*}}, i32 0, i32 3, i64 0
+; CHECK:       %laddr = getelementptr inbounds %struct.T.reordered, %struct.T.reordered* {{%.*}}, i32 0, i32 0
+; CHECK:       %raddr = getelementptr inbounds %struct.T.reordered, %struct.T.reordered* {{%.*}}, i32 0, i32 1
+; CHECK-LABEL: define internal i64 @sum(
+; CHECK:       %kaddr = getelementptr inbounds %struct.T.reordered, %struct.T.reordered* {{%.*}}, i32 0, i32 2
+
+; KEEP-NOT:    %struct.T.reordered
+; KEEP:        %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+; KEEP-NOT:    %struct.T.reordered
+
+%struct.T = type { i64, [16 x i64], %struct.T*, %struct.T* }
+
+declare noalias i8* @malloc(i64)
+;DECL declare void @dump(%struct.T*)
+
+define internal %struct.T* @make(i64 %k) {
+  %mem = call i8* @malloc(i64 152)
+  %t = bitcast i8* %mem to %struct.T*
+  %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+  store i64 %k, i64* %kaddr
+  %paddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 1, i64 0
+  store i64 %k, i64* %paddr
+  %laddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 2
+  store %struct.T* null, %struct.T** %laddr
+  %raddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 3
+  store %struct.T* null, %struct.T** %raddr
+  ret %struct.T* %t
+}
+
+define internal i64 @sum(%struct.T* %t) {
+entry:
+  %null = icmp eq %struct.T* %t, null
+  br i1 %null, label %done, label %node
+
+node:
+  %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+  %k = load i64, i64* %kaddr
+  %laddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 2
+  %l = load %struct.T*, %struct.T** %laddr
+  %raddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 3
+  %r = load %struct.T*, %struct.T** %raddr
+  %ls = call i64 @sum(%struct.T* %l)
+  %rs = call i64 @sum(%struct.T* %r)
+  %s = add i64 %ls, %rs
+  %res = add i64 %s, %k
+  ret i64 %res
+
+done:
+  ret i64 0
+}
+
+define i64 @main() {
+  %t = call %struct.T* @make(i64 1)
+  %s = call i64 @sum(%struct.T* %t)
+  ret i64 %s
+}
@@ -0,0 +1,105 @@
+; Search descents, whether the child is picked by a select or by exclusive
+; branches that each recurse into one member, prefetch the candidates two levels
+; down. A walk that visits both children is not a descent.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-search -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=OFF
+
+; CHECK-LABEL: define i32 @find_select(
+; CHECK:       conditional:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       prefetch-child:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       prefetch-child3:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       entry.split:
+
+; CHECK-LABEL: define i32 @find_branch(
+; CHECK:       conditional:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       prefetch-child:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       prefetch-child3:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       entry.split:
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK-NOT:   prefetch-child
+; CHECK:       ret i32
+
+; OFF-NOT:     prefetch-child
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+define i32 @find_select(%struct.Tree* %t, i32 %k) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %kaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %key = load i32, i32* %kaddr
+  %less = icmp slt i32 %k, %key
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %next = select i1 %less, %struct.Tree* %l, %struct.Tree* %r
+  %s = call i32 @find_select(%struct.Tree* %next, i32 %k)
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s, %body ]
+  ret i32 %res
+}
+
+define i32 @find_branch(%struct.Tree* %t, i32 %k) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %kaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %key = load i32, i32* %kaddr
+  %less = icmp slt i32 %k, %key
+  br i1 %less, label %left, label %right
+
+left:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @find_branch(%struct.Tree* %l, i32 %k)
+  br label %exit
+
+right:
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @find_branch(%struct.Tree* %r, i32 %k)
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %ls, %left ], [ %rs, %right ]
+  ret i32 %res
+}
+
+; both children are visited, not a descent
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
@@ -0,0 +1,54 @@
+; Inside the loop over a bounded child array, the children k slots ahead are
+; prefetched right before each recursive call, and the entry prefetch is cut to
+; the first child.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-sibling-distance=2 -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s --check-prefix=ENTRY
+
+; CHECK-LABEL: define i32 @nary(
+; CHECK:       conditional:
+; CHECK:       %child.bound = select i1 {{%.*}}, i64 {{%.*}}, i64 1
+; CHECK:       loop:
+; CHECK:       [[I:%.*]] = sext i32 %i to i64
+; CHECK:       [[FIRST:%.*]] = icmp eq i64 [[I]], 0
+; CHECK-NEXT:  [[AHEAD:%.*]] = add i64 [[I]], 2
+; CHECK-NEXT:  %sibling.begin = select i1 [[FIRST]], i64 1, i64 [[AHEAD]]
+; CHECK-NEXT:  [[END:%.*]] = add i64 [[AHEAD]], 1
+; CHECK:       %sibling.end = select i1 {{%.*}}, i64 [[END]], i64 {{%.*}}
+; CHECK:       prefetch-array2:
+; CHECK-NEXT:  %child.index4 = phi i64 [ %sibling.begin, %loop ]
+; CHECK:       call void @llvm.prefetch
+; CHECK:       loop.split:
+; CHECK-NEXT:  %cs = call i32 @nary(
+
+; ENTRY-LABEL: define i32 @nary(
+; ENTRY:       %child.bound = select i1 {{%.*}}, i64 {{%.*}}, i64 16
+; ENTRY-NOT:   sibling.begin
+; ENTRY:       ret i32
+
+%struct.Nary = type { i32, i32, [4 x %struct.Nary*] }
+
+define i32 @nary(%struct.Nary* %n) {
+entry:
+  %cntaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 1
+  %cnt = load i32, i32* %cntaddr
+  %vaddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %any = icmp sgt i32 %cnt, 0
+  br i1 %any, label %loop, label %exit
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inext, %loop ]
+  %acc = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  %idx = sext i32 %i to i64
+  %caddr = getelementptr inbounds %struct.Nary, %struct.Nary* %n, i32 0, i32 2, i64 %idx
+  %c = load %struct.Nary*, %struct.Nary** %caddr
+  %cs = call i32 @nary(%struct.Nary* %c)
+  %sum = add i32 %acc, %cs
+  %inext = add nsw i32 %i, 1
+  %more = icmp slt i32 %inext, %cnt
+  br i1 %more, label %loop, label %exit
+
+exit:
+  %res = phi i32 [ %v, %entry ], [ %sum, %loop ]
+  ret i32 %res
+}
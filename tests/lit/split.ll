@@ -0,0 +1,68 @@
+; Splitting moves the members traversals never read behind a pointer to a cold
+; struct. It needs to see every place a node goes, so nothing happens when a
+; function taking or returning nodes can be called from another module, or a
+; declaration has nodes in its signature.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-split -S %s | FileCheck %s
+; RUN: sed 's/define internal i64 @sum/define i64 @sum/' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-split -S | FileCheck %s --check-prefix=KEEP
+; RUN: sed 's/internal \(.*@make\)/\1/' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-split -S | FileCheck %s --check-prefix=KEEP
+; RUN: sed 's/^;DECL //' %s | %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-split -S | FileCheck %s --check-prefix=KEEP
+
+; CHECK:       %struct.T.hot = type { i64, %struct.T*, %struct.T*, %struct.T.cold* }
+; CHECK:       %struct.T.cold = type { [4 x i64] }
+; CHECK-LABEL: define internal %struct.T* @make(
+; CHECK:       %mem = call i8* @malloc(i64 32)
+; CHECK:       %mem.cold = call i8* @malloc(i64 32)
+; CHECK:       %paddr = getelementptr inbounds %struct.T.cold, %struct.T.cold* {{%.*}}, i32 0, i32 0, i64 0
+; CHECK-LABEL: define internal i64 @sum(
+; CHECK:       %laddr = getelementptr inbounds %struct.T.hot, %struct.T.hot* {{%.*}}, i32 0, i32 1
+
+; KEEP-NOT:    %struct.T.hot
+; KEEP-NOT:    %struct.T.cold
+; KEEP:        call i8* @malloc(i64 56)
+
+%struct.T = type { i64, [4 x i64], %struct.T*, %struct.T* }
+
+declare noalias i8* @malloc(i64)
+;DECL declare void @dump(%struct.T*)
+
+define internal %struct.T* @make(i64 %k) {
+  %mem = call i8* @malloc(i64 56)
+  %t = bitcast i8* %mem to %struct.T*
+  %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+  store i64 %k, i64* %kaddr
+  %paddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 1, i64 0
+  store i64 %k, i64* %paddr
+  %laddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 2
+  store %struct.T* null, %struct.T** %laddr
+  %raddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 3
+  store %struct.T* null, %struct.T** %raddr
+  ret %struct.T* %t
+}
+
+define internal i64 @sum(%struct.T* %t) {
+entry:
+  %null = icmp eq %struct.T* %t, null
+  br i1 %null, label %done, label %node
+
+node:
+  %kaddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 0
+  %k = load i64, i64* %kaddr
+  %laddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 2
+  %l = load %struct.T*, %struct.T** %laddr
+  %raddr = getelementptr inbounds %struct.T, %struct.T* %t, i32 0, i32 3
+  %r = load %struct.T*, %struct.T** %raddr
+  %ls = call i64 @sum(%struct.T* %l)
+  %rs = call i64 @sum(%struct.T* %r)
+  %s = add i64 %ls, %rs
+  %res = add i64 %s, %k
+  ret i64 %res
+
+done:
+  ret i64 0
+}
+
+define i64 @main() {
+  %t = call %struct.T* @make(i64 1)
+  %s = call i64 @sum(%struct.T* %t)
+  ret i64 %s
+}
@@ -0,0 +1,55 @@
+; Only the record pointers the traversal dereferences are prefetched, at the
+; line of the member it reads.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -S %s | FileCheck %s
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-used-fields=false -S %s | FileCheck %s --check-prefix=ALL
+
+; CHECK-LABEL: define i64 @sum(
+; CHECK:       conditional:
+; CHECK:       call void @llvm.prefetch.{{.*}}(%struct.Tree* {{.*}}, i32 0, i32 3, i32 1)
+; CHECK:       call void @llvm.prefetch.{{.*}}(%struct.Tree* {{.*}}, i32 0, i32 3, i32 1)
+; CHECK:       [[D:%.*]] = load %struct.Data*, %struct.Data**
+; CHECK-NEXT:  [[D8:%.*]] = bitcast %struct.Data* [[D]] to i8*
+; CHECK-NEXT:  [[V:%.*]] = getelementptr i8, i8* [[D8]], i64 8
+; CHECK-NEXT:  call void @llvm.prefetch.p0i8(i8* [[V]], i32 0, i32 3, i32 1)
+; Neither the parent link nor the pointer only copied to @sink.
+; CHECK-NOT:   call void @llvm.prefetch
+; CHECK:       entry.split:
+
+; ALL-LABEL: define i64 @sum(
+; ALL:       conditional:
+; ALL-COUNT-2: call void @llvm.prefetch.{{.*}}(%struct.Tree*
+; ALL:       call void @llvm.prefetch.{{.*}}(%struct.Data* {{.*}}, i32 0, i32 3, i32 1)
+; ALL:       entry.split:
+
+%struct.Data = type { i64, i64 }
+%struct.Tree = type { %struct.Tree*, %struct.Tree*, %struct.Tree*, %struct.Data*, %struct.Data* }
+
+@sink = global %struct.Data* null
+
+define i64 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %daddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 3
+  %d = load %struct.Data*, %struct.Data** %daddr
+  %vaddr = getelementptr inbounds %struct.Data, %struct.Data* %d, i32 0, i32 1
+  %v = load i64, i64* %vaddr
+  %uaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 4
+  %u = load %struct.Data*, %struct.Data** %uaddr
+  store %struct.Data* %u, %struct.Data** @sink
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i64 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i64 @sum(%struct.Tree* %r)
+  %s = add i64 %ls, %rs
+  %s2 = add i64 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %s2, %body ]
+  ret i64 %res
+}
@@ -0,0 +1,82 @@
+; When the recursive calls visit different members in a fixed order, the child
+; visited first isn't prefetched (it is needed right away), its children are.
+; RUN: %opt -passes=greedy-prefetch -greedy-prefetch-hints=false -greedy-prefetch-visit-order -S %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @sum(
+; CHECK:       conditional:
+; CHECK-NEXT:  [[RA:%.*]] = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+; CHECK-NEXT:  [[R:%.*]] = load %struct.Tree*, %struct.Tree** [[RA]]
+; CHECK-NEXT:  call void @llvm.prefetch.{{.*}}(%struct.Tree* [[R]],
+; CHECK-NEXT:  [[LA:%.*]] = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+; CHECK-NEXT:  [[L:%.*]] = load %struct.Tree*, %struct.Tree** [[LA]]
+; CHECK-NOT:   call void @llvm.prefetch.{{.*}}(%struct.Tree* [[L]],
+; CHECK:       prefetch-first-child:
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* [[L]], i32 0, i32 1
+; CHECK-NEXT:  load
+; CHECK-NEXT:  call void @llvm.prefetch
+; CHECK-NEXT:  getelementptr inbounds %struct.Tree, %struct.Tree* [[L]], i32 0, i32 2
+; CHECK-NEXT:  load
+; CHECK-NEXT:  call void @llvm.prefetch
+
+; CHECK-LABEL: define i32 @either(
+; CHECK-NOT:   prefetch-first-child
+; CHECK:       conditional:
+; CHECK-COUNT-2: call void @llvm.prefetch
+; CHECK:       entry.split:
+
+%struct.Tree = type { i32, %struct.Tree*, %struct.Tree* }
+
+
+
+
+define i32 @sum(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @sum(%struct.Tree* %l)
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @sum(%struct.Tree* %r)
+  %s = add i32 %ls, %rs
+  %s2 = add i32 %s, %v
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %s2, %body ]
+  ret i32 %res
+}
+
+; the calls are on exclusive paths, neither is visited first
+define i32 @either(%struct.Tree* %t) {
+entry:
+  %isnull = icmp eq %struct.Tree* %t, null
+  br i1 %isnull, label %exit, label %body
+
+body:
+  %vaddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 0
+  %v = load i32, i32* %vaddr
+  %odd = icmp slt i32 %v, 0
+  br i1 %odd, label %left, label %right
+
+left:
+  %laddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 1
+  %l = load %struct.Tree*, %struct.Tree** %laddr
+  %ls = call i32 @either(%struct.Tree* %l)
+  br label %exit
+
+right:
+  %raddr = getelementptr inbounds %struct.Tree, %struct.Tree* %t, i32 0, i32 2
+  %r = load %struct.Tree*, %struct.Tree** %raddr
+  %rs = call i32 @either(%struct.Tree* %r)
+  br label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %ls, %left ], [ %rs, %right ]
+  ret i32 %res
+}